@@ -0,0 +1,526 @@
+#ifndef BENCHMARK_H
+#define BENCHMARK_H
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <iomanip>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+#ifdef __linux__
+#include <pthread.h>
+#include <sched.h>
+#endif
+#include "RECORD.h"
+
+// Benchmark harness: seeded workload generation, per-operation timing and
+// reporting.
+//
+// Everything a measured loop touches is generated up front from one seed:
+// the records to preload, the operation stream, and the record each insert
+// adds. Running with the same options and seed replays the same workload.
+// The timed regions then only call into the tree.
+//
+// Ids: preload record j has id 2 * j, so every odd id is a guaranteed miss.
+// Searches hit with the configured probability (counted against the
+// preload), inserts add odd ids, and removes target preloaded ids.
+
+// SplitMix64, used to expand one seed into generator states
+class SplitMix64 {
+private:
+    uint64_t state;
+
+public:
+    explicit SplitMix64(uint64_t seed) : state(seed) {}
+
+    uint64_t next() {
+        uint64_t z = (state += 0x9E3779B97F4A7C15ULL);
+        z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+        z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+        return z ^ (z >> 31);
+    }
+};
+
+// xoshiro256**: fast, small-state PRNG for workload generation
+class Xoshiro256 {
+private:
+    uint64_t s[4];
+
+    static uint64_t rotl(uint64_t x, int k) {
+        return (x << k) | (x >> (64 - k));
+    }
+
+public:
+    explicit Xoshiro256(uint64_t seed) {
+        SplitMix64 sm(seed);
+        for (int i = 0; i < 4; i++)
+            s[i] = sm.next();
+    }
+
+    uint64_t next() {
+        uint64_t result = rotl(s[1] * 5, 7) * 9;
+        uint64_t t = s[1] << 17;
+        s[2] ^= s[0];
+        s[3] ^= s[1];
+        s[1] ^= s[2];
+        s[0] ^= s[3];
+        s[2] ^= t;
+        s[3] = rotl(s[3], 45);
+        return result;
+    }
+
+    // Uniform in [0, n), by multiply-shift instead of a division
+    uint64_t below(uint64_t n) {
+        return (uint64_t)(((unsigned __int128)next() * n) >> 64);
+    }
+
+    // Uniform in [0, 1)
+    double unit() {
+        return (next() >> 11) * 0x1.0p-53;
+    }
+};
+
+enum class KeyDistribution { Uniform, Zipfian, Sorted, Reverse };
+
+inline const char* distributionName(KeyDistribution d) {
+    switch (d) {
+        case KeyDistribution::Uniform: return "uniform";
+        case KeyDistribution::Zipfian: return "zipf";
+        case KeyDistribution::Sorted:  return "sorted";
+        case KeyDistribution::Reverse: return "reverse";
+    }
+    return "?";
+}
+
+inline KeyDistribution parseDistribution(const std::string& s) {
+    if (s == "uniform") return KeyDistribution::Uniform;
+    if (s == "zipf" || s == "zipfian") return KeyDistribution::Zipfian;
+    if (s == "sorted") return KeyDistribution::Sorted;
+    if (s == "reverse") return KeyDistribution::Reverse;
+    throw std::invalid_argument("unknown distribution: " + s);
+}
+
+// Zipfian ranks over [0, n) with skew theta in (0, 1), following Gray et
+// al. ("Quickly generating billion-record synthetic databases") as YCSB does
+class ZipfianGenerator {
+private:
+    uint64_t n;
+    double theta, alpha, zetan, eta, half;
+
+    static double zeta(uint64_t n, double theta) {
+        double sum = 0;
+        for (uint64_t i = 1; i <= n; i++)
+            sum += 1.0 / std::pow((double)i, theta);
+        return sum;
+    }
+
+public:
+    ZipfianGenerator(uint64_t _n, double _theta) : n(_n), theta(_theta) {
+        if (!(theta > 0 && theta < 1))
+            throw std::invalid_argument("zipf theta must be in (0, 1)");
+        zetan = zeta(n, theta);
+        alpha = 1.0 / (1.0 - theta);
+        eta = (1.0 - std::pow(2.0 / n, 1.0 - theta)) / (1.0 - zeta(2, theta) / zetan);
+        half = 1.0 + std::pow(0.5, theta);
+    }
+
+    // Rank 0 is the most popular
+    uint64_t next(Xoshiro256& rng) {
+        double u = rng.unit();
+        double uz = u * zetan;
+        if (uz < 1.0)
+            return 0;
+        if (uz < half)
+            return 1;
+        uint64_t r = (uint64_t)(n * std::pow(eta * u - eta + 1.0, alpha));
+        return r < n ? r : n - 1;
+    }
+};
+
+// Picks positions in [0, n) for the i-th of `count` draws
+class KeyPicker {
+private:
+    KeyDistribution dist;
+    uint64_t n, count;
+    std::vector<ZipfianGenerator> zipf;      // empty unless dist is Zipfian
+
+public:
+    KeyPicker(KeyDistribution _dist, uint64_t _n, uint64_t _count, double theta)
+        : dist(_dist), n(_n), count(_count ? _count : 1) {
+        if (dist == KeyDistribution::Zipfian)
+            zipf.emplace_back(n, theta);
+    }
+
+    uint64_t pick(uint64_t i, Xoshiro256& rng) {
+        switch (dist) {
+            case KeyDistribution::Uniform:
+                return rng.below(n);
+            case KeyDistribution::Zipfian: {
+                // Scatter the ranks so the hot keys are not neighbours in the tree
+                uint64_t h = zipf[0].next(rng) * 0x9E3779B97F4A7C15ULL;
+                return (h ^ (h >> 29)) % n;
+            }
+            case KeyDistribution::Sorted:
+                return (uint64_t)((unsigned __int128)i * n / count);
+            case KeyDistribution::Reverse:
+                return n - 1 - (uint64_t)((unsigned __int128)i * n / count);
+        }
+        return 0;
+    }
+};
+
+struct WorkloadConfig {
+    size_t records = 1000000;            // preloaded before the mixed phase
+    size_t operations = 1000000;         // length of the mixed operation stream
+    KeyDistribution distribution = KeyDistribution::Uniform;
+    double zipfTheta = 0.99;
+    double hitRatio = 0.9;               // chance that a search targets a preloaded id
+    int readPercent = 90;                // the remainder after reads and inserts are removes
+    int insertPercent = 5;
+    uint64_t seed = 42;
+};
+
+enum class OpType : uint8_t { Search, Insert, Remove };
+
+struct Operation {
+    OpType type;
+    int id;
+    uint32_t record;                     // index into Workload::inserts for inserts
+};
+
+template<typename RecordT>
+struct Workload {
+    std::vector<RecordT> load;           // preload, in the order the distribution inserts it
+    std::vector<Operation> ops;
+    std::vector<RecordT> inserts;        // one record per insert operation
+    std::vector<int> searchIds;          // the search operations' ids, for searchBatch
+};
+
+inline std::string randomName(Xoshiro256& rng) {
+    std::string s(4, 'A');
+    for (char& c : s)
+        c = (char)('A' + rng.below(26));
+    return s;
+}
+
+template<typename RecordT>
+Workload<RecordT> generateWorkload(const WorkloadConfig& cfg) {
+    if (cfg.records == 0 || cfg.records > (size_t)INT32_MAX / 2)
+        throw std::invalid_argument("records must be in [1, 2^30)");
+    if (cfg.readPercent < 0 || cfg.insertPercent < 0 || cfg.readPercent + cfg.insertPercent > 100)
+        throw std::invalid_argument("read and insert percentages must add up to at most 100");
+
+    Xoshiro256 rng(cfg.seed);
+    Workload<RecordT> w;
+
+    // Preload order: ascending, descending, or shuffled
+    std::vector<int> order(cfg.records);
+    for (size_t j = 0; j < cfg.records; j++)
+        order[j] = (int)j;
+    if (cfg.distribution == KeyDistribution::Reverse) {
+        std::reverse(order.begin(), order.end());
+    } else if (cfg.distribution != KeyDistribution::Sorted) {
+        for (size_t j = cfg.records - 1; j > 0; j--)
+            std::swap(order[j], order[rng.below(j + 1)]);
+    }
+    w.load.reserve(cfg.records);
+    for (int j : order)
+        w.load.emplace_back(2 * j, randomName(rng), (int)rng.below(100));
+
+    KeyPicker picker(cfg.distribution, cfg.records, cfg.operations, cfg.zipfTheta);
+    w.ops.reserve(cfg.operations);
+    for (size_t i = 0; i < cfg.operations; i++) {
+        int roll = (int)rng.below(100);
+        int slot = (int)picker.pick(i, rng);
+        Operation op;
+        op.record = 0;
+        if (roll < cfg.readPercent) {
+            op.type = OpType::Search;
+            op.id = rng.unit() < cfg.hitRatio ? 2 * slot : 2 * slot + 1;
+            w.searchIds.push_back(op.id);
+        } else if (roll < cfg.readPercent + cfg.insertPercent) {
+            op.type = OpType::Insert;
+            op.id = 2 * slot + 1;
+            op.record = (uint32_t)w.inserts.size();
+            w.inserts.emplace_back(op.id, randomName(rng), (int)rng.below(100));
+        } else {
+            op.type = OpType::Remove;
+            op.id = 2 * slot;
+        }
+        w.ops.push_back(op);
+    }
+    return w;
+}
+
+// One worker's slice of a sharded run: a workload of about 1/shards of the
+// records and operations, drawn from its own seed, with every id mapped to
+// id * shards + shard so that shard owns exactly the ids congruent to it.
+// Each worker generates its slice on its own thread, so there is no shared
+// generator, and the slices partition the id space without coordination.
+template<typename RecordT>
+Workload<RecordT> shardWorkload(const WorkloadConfig& cfg, int shards, int shard) {
+    WorkloadConfig local = cfg;
+    local.records = std::max<size_t>(1, cfg.records * (shard + 1) / shards - cfg.records * shard / shards);
+    local.operations = cfg.operations * (shard + 1) / shards - cfg.operations * shard / shards;
+    local.seed = SplitMix64(cfg.seed ^ (uint64_t)shard * 0x9E3779B97F4A7C15ULL).next();
+
+    Workload<RecordT> w = generateWorkload<RecordT>(local);
+    auto global = [&](int id) { return id * shards + shard; };
+    for (RecordT& rec : w.load)
+        rec.id = global(rec.id);
+    for (RecordT& rec : w.inserts)
+        rec.id = global(rec.id);
+    for (Operation& op : w.ops)
+        op.id = global(op.id);
+    for (int& id : w.searchIds)
+        id = global(id);
+    return w;
+}
+
+// Pin the calling thread to one core; a no-op where affinity is not supported
+inline void pinToCore(int core) {
+#ifdef __linux__
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(core, &set);
+    pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+#else
+    (void)core;
+#endif
+}
+
+// Run fn(t) on `threads` threads, thread t pinned to core t modulo the core
+// count, and wait for all of them
+template<typename Fn>
+void runPinned(int threads, Fn fn) {
+    int cores = (int)std::max(1u, std::thread::hardware_concurrency());
+    std::vector<std::thread> workers;
+    for (int t = 0; t < threads; t++) {
+        workers.emplace_back([&fn, t, cores]() {
+            pinToCore(t % cores);
+            fn(t);
+        });
+    }
+    for (auto& worker : workers)
+        worker.join();
+}
+
+// Per-operation latency samples in nanoseconds
+class LatencyRecorder {
+private:
+    std::vector<uint32_t> samples;
+
+public:
+    void reserve(size_t n) {
+        samples.reserve(samples.size() + n);
+    }
+
+    void add(double ns) {
+        samples.push_back(ns <= 0 ? 0 : ns >= 4e9 ? 4000000000u : (uint32_t)ns);
+    }
+
+    void merge(const LatencyRecorder& other) {
+        samples.insert(samples.end(), other.samples.begin(), other.samples.end());
+    }
+
+    size_t size() const {
+        return samples.size();
+    }
+
+    // The requested quantiles (each in [0, 1]) of the samples so far
+    std::vector<double> quantiles(const std::vector<double>& qs) {
+        std::vector<double> out;
+        if (samples.empty())
+            return out;
+        std::sort(samples.begin(), samples.end());
+        for (double q : qs) {
+            size_t idx = (size_t)std::ceil(q * samples.size());
+            idx = idx == 0 ? 0 : idx - 1;
+            out.push_back(samples[std::min(idx, samples.size() - 1)]);
+        }
+        return out;
+    }
+};
+
+// Mean ns per operation of each repetition
+class RepetitionStats {
+private:
+    std::vector<double> perOp;
+
+public:
+    void add(double totalNs, size_t ops) {
+        perOp.push_back(ops ? totalNs / ops : 0);
+    }
+
+    size_t size() const {
+        return perOp.size();
+    }
+
+    double mean() const {
+        double sum = 0;
+        for (double v : perOp)
+            sum += v;
+        return perOp.empty() ? 0 : sum / perOp.size();
+    }
+
+    double stddev() const {
+        if (perOp.size() < 2)
+            return 0;
+        double m = mean(), sq = 0;
+        for (double v : perOp)
+            sq += (v - m) * (v - m);
+        return std::sqrt(sq / (perOp.size() - 1));
+    }
+
+    double min() const {
+        return perOp.empty() ? 0 : *std::min_element(perOp.begin(), perOp.end());
+    }
+
+    double max() const {
+        return perOp.empty() ? 0 : *std::max_element(perOp.begin(), perOp.end());
+    }
+};
+
+typedef std::chrono::steady_clock BenchClock;
+
+inline double elapsedNs(BenchClock::time_point start, BenchClock::time_point stop) {
+    return (double)std::chrono::duration_cast<std::chrono::nanoseconds>(stop - start).count();
+}
+
+// Median cost of reading the clock twice, subtracted from every sample
+inline double clockOverheadNs() {
+    static const double overhead = [] {
+        std::vector<double> v(10001);
+        for (double& d : v) {
+            auto a = BenchClock::now();
+            auto b = BenchClock::now();
+            d = elapsedNs(a, b);
+        }
+        std::nth_element(v.begin(), v.begin() + v.size() / 2, v.end());
+        return v[v.size() / 2];
+    }();
+    return overhead;
+}
+
+// Run fn(i) for every i in [0, n), recording each call's latency.
+// Returns the wall time of the whole loop in nanoseconds.
+template<typename Fn>
+double timeEach(size_t n, LatencyRecorder& latency, Fn fn) {
+    double overhead = clockOverheadNs();
+    latency.reserve(n);
+    auto start = BenchClock::now();
+    for (size_t i = 0; i < n; i++) {
+        auto a = BenchClock::now();
+        fn(i);
+        auto b = BenchClock::now();
+        latency.add(elapsedNs(a, b) - overhead);
+    }
+    return elapsedNs(start, BenchClock::now());
+}
+
+// Wall time of one call to fn, for phases that cannot be split per operation
+template<typename Fn>
+double timeOnce(Fn fn) {
+    auto start = BenchClock::now();
+    fn();
+    return elapsedNs(start, BenchClock::now());
+}
+
+// Keeps lookups from being optimised away
+inline volatile size_t benchmarkSink;
+
+struct BenchmarkResult {
+    std::string structure;
+    std::string layout;
+    std::string phase;
+    std::string distribution;
+    int threads = 1;
+    size_t ops = 0;                      // per repetition
+    size_t repetitions = 0;
+    double meanNs = 0, stddevNs = 0, minNs = 0, maxNs = 0;   // across repetitions
+    bool hasPercentiles = false;         // batch phases only have a mean
+    double p50 = 0, p90 = 0, p99 = 0, p999 = 0, pmax = 0;
+};
+
+inline BenchmarkResult makeResult(const std::string& structure, const std::string& layout, const std::string& phase,
+                                  const std::string& distribution, int threads, size_t ops,
+                                  const RepetitionStats& reps, LatencyRecorder* latency) {
+    BenchmarkResult r;
+    r.structure = structure;
+    r.layout = layout;
+    r.phase = phase;
+    r.distribution = distribution;
+    r.threads = threads;
+    r.ops = ops;
+    r.repetitions = reps.size();
+    r.meanNs = reps.mean();
+    r.stddevNs = reps.stddev();
+    r.minNs = reps.min();
+    r.maxNs = reps.max();
+    if (latency && latency->size()) {
+        std::vector<double> q = latency->quantiles({0.5, 0.9, 0.99, 0.999, 1.0});
+        r.hasPercentiles = true;
+        r.p50 = q[0];
+        r.p90 = q[1];
+        r.p99 = q[2];
+        r.p999 = q[3];
+        r.pmax = q[4];
+    }
+    return r;
+}
+
+// Report formats: "table" for people, "csv" and "json" for tracking over time
+inline void printReport(const std::vector<BenchmarkResult>& results, const std::string& format, std::ostream& os) {
+    if (format == "csv") {
+        os << "structure,layout,phase,distribution,threads,ops,repetitions,"
+              "mean_ns,stddev_ns,min_ns,max_ns,p50_ns,p90_ns,p99_ns,p999_ns,pmax_ns\n";
+        for (const BenchmarkResult& r : results) {
+            os << r.structure << ',' << r.layout << ',' << r.phase << ',' << r.distribution << ','
+               << r.threads << ',' << r.ops << ',' << r.repetitions << ','
+               << std::fixed << std::setprecision(2)
+               << r.meanNs << ',' << r.stddevNs << ',' << r.minNs << ',' << r.maxNs;
+            if (r.hasPercentiles)
+                os << ',' << r.p50 << ',' << r.p90 << ',' << r.p99 << ',' << r.p999 << ',' << r.pmax << '\n';
+            else
+                os << ",,,,,\n";
+        }
+    } else if (format == "json") {
+        os << "[\n";
+        for (size_t i = 0; i < results.size(); i++) {
+            const BenchmarkResult& r = results[i];
+            os << "  {\"structure\": \"" << r.structure << "\", \"layout\": \"" << r.layout
+               << "\", \"phase\": \"" << r.phase << "\", \"distribution\": \"" << r.distribution
+               << "\", \"threads\": " << r.threads << ", \"ops\": " << r.ops
+               << ", \"repetitions\": " << r.repetitions
+               << std::fixed << std::setprecision(2)
+               << ", \"mean_ns\": " << r.meanNs << ", \"stddev_ns\": " << r.stddevNs
+               << ", \"min_ns\": " << r.minNs << ", \"max_ns\": " << r.maxNs;
+            if (r.hasPercentiles)
+                os << ", \"p50_ns\": " << r.p50 << ", \"p90_ns\": " << r.p90 << ", \"p99_ns\": " << r.p99
+                   << ", \"p999_ns\": " << r.p999 << ", \"pmax_ns\": " << r.pmax;
+            os << "}" << (i + 1 < results.size() ? "," : "") << "\n";
+        }
+        os << "]\n";
+    } else {
+        os << std::left << std::setw(16) << "Structure" << std::setw(14) << "Phase" << std::setw(9) << "Threads"
+           << std::setw(10) << "Ops" << std::setw(12) << "Mean ns" << std::setw(10) << "+/-"
+           << std::setw(10) << "p50" << std::setw(10) << "p99" << std::setw(10) << "p99.9" << "max" << "\n";
+        os << std::string(110, '-') << "\n";
+        for (const BenchmarkResult& r : results) {
+            os << std::left << std::setw(16) << r.structure << std::setw(14) << r.phase << std::setw(9) << r.threads
+               << std::setw(10) << r.ops << std::fixed << std::setprecision(1)
+               << std::setw(12) << r.meanNs << std::setw(10) << r.stddevNs;
+            if (r.hasPercentiles)
+                os << std::setw(10) << r.p50 << std::setw(10) << r.p99 << std::setw(10) << r.p999 << r.pmax;
+            else
+                os << std::setw(10) << "-" << std::setw(10) << "-" << std::setw(10) << "-" << "-";
+            os << "\n";
+        }
+    }
+}
+
+#endif
@@ -0,0 +1,79 @@
+#ifndef BULK_LOAD_H
+#define BULK_LOAD_H
+
+#include <algorithm>
+#include <iterator>
+#include <utility>
+#include <vector>
+#include "RECORD.h"
+#include "INDEX_POLICY.h"
+
+// Shared preparation step for the bulkLoad() builders: every tree builds
+// bottom-up from a vector of records sorted by key with no duplicates. The
+// key defaults to the id, as for the trees themselves.
+
+// Copy [first, last) into records of the tree's layout sorted by key,
+// keeping the first record seen for each key (the same record a sequence of
+// insert() calls would have kept)
+template<typename RecordT, typename KeyOf = RecordId, typename Compare = std::less<>, typename It>
+std::vector<RecordT> sortedUniqueRecords(It first, It last) {
+    std::vector<RecordT> recs(first, last);
+
+    auto byKey = [](const RecordT& a, const RecordT& b) { return Compare()(KeyOf()(a), KeyOf()(b)); };
+    if (!std::is_sorted(recs.begin(), recs.end(), byKey))
+        std::stable_sort(recs.begin(), recs.end(), byKey);
+
+    auto sameKey = [](const RecordT& a, const RecordT& b) { return keysEqual<Compare>(KeyOf()(a), KeyOf()(b)); };
+    recs.erase(std::unique(recs.begin(), recs.end(), sameKey), recs.end());
+    return recs;
+}
+
+// Copy [first, last) sorted by key like sortedUniqueRecords, but keeping the
+// last record seen for each key, as a sequence of upserts would
+template<typename RecordT, typename KeyOf = RecordId, typename Compare = std::less<>, typename It>
+std::vector<RecordT> sortedLatestRecords(It first, It last) {
+    std::vector<RecordT> recs(first, last);
+
+    auto byKey = [](const RecordT& a, const RecordT& b) { return Compare()(KeyOf()(a), KeyOf()(b)); };
+    if (!std::is_sorted(recs.begin(), recs.end(), byKey))
+        std::stable_sort(recs.begin(), recs.end(), byKey);
+
+    // Each record is kept only if the next one has a different key
+    size_t kept = 0;
+    for (size_t i = 0; i < recs.size(); i++) {
+        if (i + 1 < recs.size() && keysEqual<Compare>(KeyOf()(recs[i]), KeyOf()(recs[i + 1])))
+            continue;
+        if (kept != i)
+            recs[kept] = std::move(recs[i]);
+        kept++;
+    }
+    recs.erase(recs.begin() + kept, recs.end());
+    return recs;
+}
+
+// Merge the records already in a tree with a prepared batch. Both inputs are
+// sorted and unique; on equal keys the existing record wins, as with insert().
+template<typename KeyOf = RecordId, typename Compare = std::less<>, typename RecordT>
+std::vector<RecordT> mergeSortedRecords(std::vector<RecordT>&& existing, std::vector<RecordT>&& incoming) {
+    if (existing.empty())
+        return std::move(incoming);
+
+    std::vector<RecordT> merged;
+    merged.reserve(existing.size() + incoming.size());
+
+    size_t i = 0, j = 0;
+    while (i < existing.size() && j < incoming.size()) {
+        if (Compare()(KeyOf()(incoming[j]), KeyOf()(existing[i]))) {
+            merged.push_back(std::move(incoming[j++]));
+        } else {
+            if (!Compare()(KeyOf()(existing[i]), KeyOf()(incoming[j])))
+                j++;
+            merged.push_back(std::move(existing[i++]));
+        }
+    }
+    std::move(existing.begin() + i, existing.end(), std::back_inserter(merged));
+    std::move(incoming.begin() + j, incoming.end(), std::back_inserter(merged));
+    return merged;
+}
+
+#endif
@@ -0,0 +1,171 @@
+#ifndef EPOCH_RECLAIM_H
+#define EPOCH_RECLAIM_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <stdexcept>
+#include <vector>
+
+// Epoch-based memory reclamation for the lock-free indexes.
+//
+// A thread announces the global epoch while it is inside an operation (an
+// EpochDomain::Guard is alive) and clears the announcement when it leaves.
+// Unlinked nodes are not freed immediately but retired, tagged with the
+// epoch at retirement. The global epoch only advances once every thread
+// inside an operation has announced the current value, so by the time it
+// has moved two epochs past a node's tag, every thread that could still have
+// held a pointer to that node has left its operation, and the node is freed.
+
+const int EPOCH_MAX_THREADS = 256;
+
+// Process-wide table handing each live thread a small index, shared by all domains
+inline std::atomic<bool> epochSlotUsed[EPOCH_MAX_THREADS];
+inline std::atomic<int> epochSlotHighWater{0};
+
+// Claims an index on a thread's first use of any domain and frees it when the thread exits
+class EpochThreadSlot {
+public:
+    int index;
+
+    EpochThreadSlot() : index(-1) {
+        for (int i = 0; i < EPOCH_MAX_THREADS; i++) {
+            bool expected = false;
+            if (!epochSlotUsed[i].load(std::memory_order_relaxed) &&
+                epochSlotUsed[i].compare_exchange_strong(expected, true, std::memory_order_acq_rel)) {
+                index = i;
+                break;
+            }
+        }
+        if (index < 0)
+            throw std::runtime_error("more than EPOCH_MAX_THREADS threads use epoch reclamation");
+
+        int high = epochSlotHighWater.load(std::memory_order_relaxed);
+        while (high <= index && !epochSlotHighWater.compare_exchange_weak(high, index + 1, std::memory_order_acq_rel)) {}
+    }
+
+    ~EpochThreadSlot() {
+        epochSlotUsed[index].store(false, std::memory_order_release);
+    }
+};
+
+inline int epochThreadIndex() {
+    thread_local EpochThreadSlot slot;
+    return slot.index;
+}
+
+class EpochDomain {
+private:
+    static const uint64_t QUIESCENT = 0;          // Announced by threads outside any operation
+    static const size_t COLLECT_INTERVAL = 64;     // Retirements between reclamation attempts
+
+    struct Retired {
+        void* ptr;
+        void (*free)(void*);
+        uint64_t epoch;
+    };
+
+    // Per-thread state, padded so announcements of different threads do not share a cache line
+    struct alignas(64) Participant {
+        std::atomic<uint64_t> epoch{QUIESCENT};
+        int nesting = 0;
+        size_t sinceCollect = 0;
+        std::vector<Retired> limbo;      // Only touched by the owning thread
+    };
+
+    std::atomic<uint64_t> globalEpoch{1};
+    Participant participants[EPOCH_MAX_THREADS];
+
+    // Helper function to advance the global epoch if every active thread has caught up with it
+    void tryAdvance() {
+        uint64_t g = globalEpoch.load(std::memory_order_seq_cst);
+        int n = epochSlotHighWater.load(std::memory_order_acquire);
+        for (int i = 0; i < n; i++) {
+            uint64_t e = participants[i].epoch.load(std::memory_order_seq_cst);
+            if (e != QUIESCENT && e != g)
+                return;
+        }
+        globalEpoch.compare_exchange_strong(g, g + 1, std::memory_order_seq_cst);
+    }
+
+    // Helper function to free this thread's retired nodes that no thread can still reach
+    void collect(Participant& p) {
+        tryAdvance();
+        uint64_t g = globalEpoch.load(std::memory_order_seq_cst);
+        size_t kept = 0;
+        for (size_t i = 0; i < p.limbo.size(); i++) {
+            if (p.limbo[i].epoch + 2 <= g)
+                p.limbo[i].free(p.limbo[i].ptr);
+            else
+                p.limbo[kept++] = p.limbo[i];
+        }
+        p.limbo.resize(kept);
+        p.sinceCollect = 0;
+    }
+
+public:
+    // Keeps the calling thread inside an operation for its lifetime; guards nest
+    class Guard {
+    private:
+        EpochDomain& domain;
+
+    public:
+        explicit Guard(EpochDomain& d) : domain(d) {
+            domain.enter();
+        }
+
+        ~Guard() {
+            domain.exit();
+        }
+
+        Guard(const Guard&) = delete;
+        Guard& operator=(const Guard&) = delete;
+    };
+
+    EpochDomain() {}
+
+    // Only safe once no other thread uses the domain
+    ~EpochDomain() {
+        for (Participant& p : participants) {
+            for (Retired& r : p.limbo)
+                r.free(r.ptr);
+        }
+    }
+
+    EpochDomain(const EpochDomain&) = delete;
+    EpochDomain& operator=(const EpochDomain&) = delete;
+
+    void enter() {
+        Participant& p = participants[epochThreadIndex()];
+        if (p.nesting++ == 0) {
+            // seq_cst so the announcement is visible before any shared pointer is read
+            p.epoch.store(globalEpoch.load(std::memory_order_seq_cst), std::memory_order_seq_cst);
+        }
+    }
+
+    void exit() {
+        Participant& p = participants[epochThreadIndex()];
+        if (--p.nesting == 0)
+            p.epoch.store(QUIESCENT, std::memory_order_release);
+    }
+
+    // Hand over an unlinked object; free(ptr) runs once no thread can still reach it.
+    // Must be called from inside an operation.
+    void retire(void* ptr, void (*free)(void*)) {
+        Participant& p = participants[epochThreadIndex()];
+        p.limbo.push_back({ptr, free, globalEpoch.load(std::memory_order_seq_cst)});
+        if (++p.sinceCollect >= COLLECT_INTERVAL)
+            collect(p);
+    }
+
+    // Number of objects retired but not yet freed, summed over all threads;
+    // only exact while no other thread uses the domain
+    size_t pending() const {
+        size_t n = 0;
+        for (const Participant& p : participants)
+            n += p.limbo.size();
+        return n;
+    }
+};
+
+#endif
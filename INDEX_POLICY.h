@@ -0,0 +1,95 @@
+#ifndef INDEX_POLICY_H
+#define INDEX_POLICY_H
+
+#include <functional>
+#include <type_traits>
+#include <utility>
+#include "NODE_SEARCH.h"
+
+// Compile-time policies shared by the ordered indexes.
+//
+// A tree is parameterized by its record type, a key extractor (KeyOf) and a
+// comparator (Compare). KeyOf is a stateless function object returning the
+// key of a record; Compare is a stateless strict weak ordering on keys. The
+// defaults key every record by its int id in ascending order, which keeps
+// the existing BST<Record>, AVL<CompactRecord>, ... spellings unchanged, and
+// lets callers index their own record types without copying into Record.
+
+// Default key extractor: the record's id
+struct RecordId {
+    template<typename RecordT>
+    int operator()(const RecordT& rec) const {
+        return rec.id;
+    }
+};
+
+// Key type produced by KeyOf for a record
+template<typename RecordT, typename KeyOf>
+using IndexKey = std::decay_t<decltype(std::declval<KeyOf>()(std::declval<const RecordT&>()))>;
+
+// True when keys are plain ints in ascending order, the case the SIMD node
+// search kernels handle
+template<typename Key, typename Compare>
+inline constexpr bool INT_ASCENDING = std::is_same_v<Key, int> &&
+    (std::is_same_v<Compare, std::less<int>> || std::is_same_v<Compare, std::less<>>);
+
+template<typename Compare, typename Key>
+inline bool keysEqual(const Key& a, const Key& b) {
+    return !Compare()(a, b) && !Compare()(b, a);
+}
+
+// First position in a sorted key array whose key is not less than key
+template<typename Compare, typename Key>
+inline int keyLowerBound(const Key* keys, int count, const Key& key) {
+    if constexpr (INT_ASCENDING<Key, Compare>) {
+        return nodeLowerBound(keys, count, key);
+    } else {
+        int lo = 0, hi = count;
+        while (lo < hi) {
+            int mid = (lo + hi) / 2;
+            if (Compare()(keys[mid], key))
+                lo = mid + 1;
+            else
+                hi = mid;
+        }
+        return lo;
+    }
+}
+
+// First position in a sorted key array whose key is greater than key
+template<typename Compare, typename Key>
+inline int keyUpperBound(const Key* keys, int count, const Key& key) {
+    if constexpr (INT_ASCENDING<Key, Compare>) {
+        return nodeUpperBound(keys, count, key);
+    } else {
+        int lo = 0, hi = count;
+        while (lo < hi) {
+            int mid = (lo + hi) / 2;
+            if (Compare()(key, keys[mid]))
+                hi = mid;
+            else
+                lo = mid + 1;
+        }
+        return lo;
+    }
+}
+
+// The common interface every point index implements: insert by record,
+// search and remove by key. Checked with static_assert by generic drivers
+// such as the benchmark, so a missing member fails at the call site with
+// one message instead of deep inside a template.
+template<typename T, typename RecordT, typename Key, typename = void>
+struct IsPointIndex : std::false_type {};
+
+template<typename T, typename RecordT, typename Key>
+struct IsPointIndex<T, RecordT, Key, std::void_t<
+    decltype(std::declval<T&>().insert(std::declval<const RecordT&>())),
+    decltype(std::declval<T&>().insert(std::declval<RecordT&&>())),
+    decltype(std::declval<T&>().remove(std::declval<const Key&>())),
+    std::enable_if_t<std::is_convertible_v<decltype(std::declval<T&>().search(std::declval<const Key&>())), const RecordT*>>>>
+    : std::true_type {};
+
+template<typename T>
+inline constexpr bool isPointIndex = IsPointIndex<T, typename T::RecordType, typename T::KeyType>::value;
+
+#endif
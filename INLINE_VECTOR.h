@@ -0,0 +1,133 @@
+#ifndef INLINE_VECTOR_H
+#define INLINE_VECTOR_H
+
+#include <algorithm>
+#include <cstddef>
+#include <iterator>
+#include <new>
+#include <type_traits>
+#include <utility>
+
+// Fixed-capacity vector with its elements stored inline, for tree nodes whose
+// fan-out is known at compile time. It supports the subset of std::vector
+// the nodes use, so a node can pick either container with a type alias; the
+// difference is that the whole node becomes one allocation of an exact size
+// instead of a header plus one heap block per array. Capacity is not checked:
+// as with std::array, exceeding N is undefined.
+template<typename T, int N>
+class InlineVector {
+private:
+    alignas(T) unsigned char storage[N * sizeof(T)];
+    int count;
+
+    T* slot(int i) {
+        return std::launder(reinterpret_cast<T*>(storage) + i);
+    }
+
+    const T* slot(int i) const {
+        return std::launder(reinterpret_cast<const T*>(storage) + i);
+    }
+
+public:
+    typedef T value_type;
+    typedef T* iterator;
+    typedef const T* const_iterator;
+
+    InlineVector() : count(0) {}
+
+    ~InlineVector() {
+        clear();
+    }
+
+    InlineVector(const InlineVector&) = delete;
+    InlineVector& operator=(const InlineVector&) = delete;
+
+    T* data() { return slot(0); }
+    const T* data() const { return slot(0); }
+    iterator begin() { return data(); }
+    iterator end() { return data() + count; }
+    const_iterator begin() const { return data(); }
+    const_iterator end() const { return data() + count; }
+
+    size_t size() const { return (size_t)count; }
+    bool empty() const { return count == 0; }
+    static constexpr size_t capacity() { return (size_t)N; }
+
+    // Storage is already in place; kept so callers can treat both containers alike
+    void reserve(size_t) {}
+
+    T& operator[](size_t i) { return data()[i]; }
+    const T& operator[](size_t i) const { return data()[i]; }
+    T& front() { return data()[0]; }
+    const T& front() const { return data()[0]; }
+    T& back() { return data()[count - 1]; }
+    const T& back() const { return data()[count - 1]; }
+
+    template<typename... Args>
+    T& emplace_back(Args&&... args) {
+        T* p = new (slot(count)) T(std::forward<Args>(args)...);
+        count++;
+        return *p;
+    }
+
+    void push_back(const T& value) { emplace_back(value); }
+    void push_back(T&& value) { emplace_back(std::move(value)); }
+
+    void pop_back() {
+        slot(--count)->~T();
+    }
+
+    void clear() {
+        if constexpr (!std::is_trivially_destructible<T>::value) {
+            for (int i = 0; i < count; i++)
+                slot(i)->~T();
+        }
+        count = 0;
+    }
+
+    // Shrink by destroying the tail, or grow with value-initialized elements
+    void resize(size_t n) {
+        while ((size_t)count > n)
+            pop_back();
+        while ((size_t)count < n)
+            emplace_back();
+    }
+
+    template<typename It>
+    void assign(It first, It last) {
+        clear();
+        for (; first != last; ++first)
+            emplace_back(*first);
+    }
+
+    iterator insert(const_iterator pos, T value) {
+        int i = (int)(pos - begin());
+        if (i == count) {
+            emplace_back(std::move(value));
+        } else {
+            emplace_back(std::move(back()));
+            std::move_backward(begin() + i, end() - 2, end() - 1);
+            data()[i] = std::move(value);
+        }
+        return begin() + i;
+    }
+
+    template<typename It>
+    iterator insert(const_iterator pos, It first, It last) {
+        int i = (int)(pos - begin());
+        int old = count;
+        for (; first != last; ++first)
+            emplace_back(*first);
+        std::rotate(begin() + i, begin() + old, end());
+        return begin() + i;
+    }
+
+    iterator erase(const_iterator pos) {
+        int i = (int)(pos - begin());
+        std::move(begin() + i + 1, end(), begin() + i);
+        pop_back();
+        return begin() + i;
+    }
+};
+
+#endif
@@ -0,0 +1,197 @@
+#ifndef NODE_ARENA_H
+#define NODE_ARENA_H
+
+#include <cstddef>
+#include <new>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+// Usage counters reported by NodeArena::stats()
+struct ArenaStats {
+    size_t chunks;          // Number of chunks obtained from the heap
+    size_t reservedNodes;   // Node slots across all chunks
+    size_t liveNodes;       // Slots currently holding a node
+    size_t freeListNodes;   // Released slots waiting to be reused
+    size_t nodeBytes;       // Size of one slot
+    size_t reservedBytes;   // Bytes held by the arena
+};
+
+// Slab allocator for one node type. Nodes are carved out of large chunks,
+// released nodes go onto a free list for reuse, and clear() hands whole
+// chunks back at once. Types that are not trivially destructible carry a
+// live flag per slot so clear() can still run their destructors.
+template<typename T, bool Trivial = std::is_trivially_destructible<T>::value>
+struct ArenaSlot {
+    alignas(T) unsigned char storage[sizeof(T)];
+    bool live;
+};
+
+template<typename T>
+struct ArenaSlot<T, true> {
+    alignas(T) unsigned char storage[sizeof(T)];
+};
+
+template<typename T>
+class NodeArena {
+private:
+    typedef ArenaSlot<T> Slot;
+
+    static_assert(sizeof(T) >= sizeof(void*) && alignof(T) >= alignof(void*),
+                  "free slots store a pointer in the node storage");
+
+    static const size_t FIRST_CHUNK_NODES = 256;
+    static const size_t MAX_CHUNK_NODES = 65536;
+    static const bool TRIVIAL = std::is_trivially_destructible<T>::value;
+
+    std::vector<Slot*> chunks;
+    std::vector<size_t> chunkNodes;
+    Slot* cursor;      // Next unused slot in the newest chunk
+    Slot* chunkEnd;
+    Slot* freeList;    // Released slots, linked through their storage
+    size_t reserved;
+    size_t live;
+    size_t freeCount;
+
+    static Slot*& nextFree(Slot* slot) {
+        return *reinterpret_cast<Slot**>(slot->storage);
+    }
+
+    // Helper function to grab a new chunk, doubling the chunk size each time
+    void grow() {
+        size_t n = chunkNodes.empty() ? FIRST_CHUNK_NODES : chunkNodes.back() * 2;
+        if (n > MAX_CHUNK_NODES)
+            n = MAX_CHUNK_NODES;
+
+        Slot* chunk = static_cast<Slot*>(::operator new(n * sizeof(Slot), std::align_val_t(alignof(Slot))));
+        chunks.push_back(chunk);
+        chunkNodes.push_back(n);
+        cursor = chunk;
+        chunkEnd = chunk + n;
+        reserved += n;
+    }
+
+    // Helper function to run destructors of nodes still alive in a chunk
+    void destroyLive(Slot* chunk, size_t n) {
+        if constexpr (!TRIVIAL) {
+            for (size_t i = 0; i < n; i++) {
+                if (chunk[i].live)
+                    reinterpret_cast<T*>(chunk[i].storage)->~T();
+            }
+        }
+    }
+
+public:
+    NodeArena() : cursor(nullptr), chunkEnd(nullptr), freeList(nullptr), reserved(0), live(0), freeCount(0) {}
+
+    ~NodeArena() {
+        clear();
+    }
+
+    NodeArena(const NodeArena&) = delete;
+    NodeArena& operator=(const NodeArena&) = delete;
+
+    // Construct a node in a free slot
+    template<typename... Args>
+    T* create(Args&&... args) {
+        Slot* slot;
+        if (freeList != nullptr) {
+            slot = freeList;
+            freeList = nextFree(slot);
+            freeCount--;
+        } else {
+            if (cursor == chunkEnd)
+                grow();
+            slot = cursor++;
+        }
+
+        T* node = new (slot->storage) T(std::forward<Args>(args)...);
+        if constexpr (!TRIVIAL)
+            slot->live = true;
+        live++;
+        return node;
+    }
+
+    // Destroy a node and put its slot on the free list
+    void destroy(T* node) {
+        Slot* slot = reinterpret_cast<Slot*>(node);
+        node->~T();
+        if constexpr (!TRIVIAL)
+            slot->live = false;
+        nextFree(slot) = freeList;
+        freeList = slot;
+        freeCount++;
+        live--;
+    }
+
+    // Release every node at once. Only walks the slots when T needs its
+    // destructor run; otherwise the cost is one free per chunk.
+    void clear() {
+        for (size_t c = 0; c < chunks.size(); c++) {
+            size_t used = chunks[c] + chunkNodes[c] == chunkEnd ? (size_t)(cursor - chunks[c]) : chunkNodes[c];
+            destroyLive(chunks[c], used);
+            ::operator delete(chunks[c], std::align_val_t(alignof(Slot)));
+        }
+        chunks.clear();
+        chunkNodes.clear();
+        cursor = chunkEnd = freeList = nullptr;
+        reserved = live = freeCount = 0;
+    }
+
+    // Take over every chunk of other, leaving it empty. Nodes keep their
+    // addresses, so pointers into the adopted chunks stay valid. The unused
+    // tail of other's newest chunk joins the free list.
+    void adopt(NodeArena& other) {
+        if (&other == this)
+            return;
+        for (Slot* slot = other.cursor; slot != other.chunkEnd; slot++) {
+            if constexpr (!TRIVIAL)
+                slot->live = false;
+            nextFree(slot) = other.freeList;
+            other.freeList = slot;
+            other.freeCount++;
+        }
+        if (other.freeList != nullptr) {
+            Slot* tail = other.freeList;
+            while (nextFree(tail) != nullptr)
+                tail = nextFree(tail);
+            nextFree(tail) = freeList;
+            freeList = other.freeList;
+        }
+
+        chunks.insert(chunks.end(), other.chunks.begin(), other.chunks.end());
+        chunkNodes.insert(chunkNodes.end(), other.chunkNodes.begin(), other.chunkNodes.end());
+        reserved += other.reserved;
+        live += other.live;
+        freeCount += other.freeCount;
+
+        other.chunks.clear();
+        other.chunkNodes.clear();
+        other.cursor = other.chunkEnd = other.freeList = nullptr;
+        other.reserved = other.live = other.freeCount = 0;
+    }
+
+    ArenaStats stats() const {
+        ArenaStats s;
+        s.chunks = chunks.size();
+        s.reservedNodes = reserved;
+        s.liveNodes = live;
+        s.freeListNodes = freeCount;
+        s.nodeBytes = sizeof(Slot);
+        s.reservedBytes = reserved * sizeof(Slot);
+        return s;
+    }
+};
+
+// Combine the counters of several arenas, e.g. for trees with two node types
+inline ArenaStats operator+(ArenaStats a, const ArenaStats& b) {
+    a.chunks += b.chunks;
+    a.reservedNodes += b.reservedNodes;
+    a.liveNodes += b.liveNodes;
+    a.freeListNodes += b.freeListNodes;
+    a.nodeBytes = a.nodeBytes > b.nodeBytes ? a.nodeBytes : b.nodeBytes;
+    a.reservedBytes += b.reservedBytes;
+    return a;
+}
+
+#endif
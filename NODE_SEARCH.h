@@ -0,0 +1,115 @@
+#ifndef NODE_SEARCH_H
+#define NODE_SEARCH_H
+
+#include <climits>
+#include <cstddef>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define NODE_SEARCH_X86 1
+#endif
+
+// Intra-node key search over a packed, sorted int array.
+//
+// Every kernel answers the same question: how many keys are < key. On a
+// sorted array that is the lower-bound position, and counting with a
+// compare + movemask over the whole node is branch-free, so it stays cheap
+// for 64-256 key nodes where a linear scan would mispredict on every probe.
+// The widest kernel the CPU supports is picked once at startup.
+
+typedef int (*NodeSearchFn)(const int* keys, int count, int key);
+
+// Portable fallback: stop at the first key that is not smaller
+inline int nodeCountLessScalar(const int* keys, int count, int key) {
+    int i = 0;
+    while (i < count && keys[i] < key)
+        i++;
+    return i;
+}
+
+#ifdef NODE_SEARCH_X86
+__attribute__((target("sse2")))
+inline int nodeCountLessSSE2(const int* keys, int count, int key) {
+    __m128i needle = _mm_set1_epi32(key);
+    int i = 0;
+    int less = 0;
+    for (; i + 16 <= count; i += 16) {
+        __m128i a = _mm_cmpgt_epi32(needle, _mm_loadu_si128((const __m128i*)(keys + i)));
+        __m128i b = _mm_cmpgt_epi32(needle, _mm_loadu_si128((const __m128i*)(keys + i + 4)));
+        __m128i c = _mm_cmpgt_epi32(needle, _mm_loadu_si128((const __m128i*)(keys + i + 8)));
+        __m128i d = _mm_cmpgt_epi32(needle, _mm_loadu_si128((const __m128i*)(keys + i + 12)));
+        __m128i ab = _mm_packs_epi32(a, b);
+        __m128i cd = _mm_packs_epi32(c, d);
+        less += __builtin_popcount(_mm_movemask_epi8(_mm_packs_epi16(ab, cd)));
+    }
+    for (; i + 4 <= count; i += 4) {
+        __m128i m = _mm_cmpgt_epi32(needle, _mm_loadu_si128((const __m128i*)(keys + i)));
+        less += __builtin_popcount(_mm_movemask_ps(_mm_castsi128_ps(m)));
+    }
+    for (; i < count; i++)
+        less += keys[i] < key;
+    return less;
+}
+
+__attribute__((target("avx2")))
+inline int nodeCountLessAVX2(const int* keys, int count, int key) {
+    __m256i needle = _mm256_set1_epi32(key);
+    int i = 0;
+    int less = 0;
+    for (; i + 32 <= count; i += 32) {
+        __m256i a = _mm256_cmpgt_epi32(needle, _mm256_loadu_si256((const __m256i*)(keys + i)));
+        __m256i b = _mm256_cmpgt_epi32(needle, _mm256_loadu_si256((const __m256i*)(keys + i + 8)));
+        __m256i c = _mm256_cmpgt_epi32(needle, _mm256_loadu_si256((const __m256i*)(keys + i + 16)));
+        __m256i d = _mm256_cmpgt_epi32(needle, _mm256_loadu_si256((const __m256i*)(keys + i + 24)));
+        less += __builtin_popcount(_mm256_movemask_ps(_mm256_castsi256_ps(a)));
+        less += __builtin_popcount(_mm256_movemask_ps(_mm256_castsi256_ps(b)));
+        less += __builtin_popcount(_mm256_movemask_ps(_mm256_castsi256_ps(c)));
+        less += __builtin_popcount(_mm256_movemask_ps(_mm256_castsi256_ps(d)));
+    }
+    for (; i + 8 <= count; i += 8) {
+        __m256i m = _mm256_cmpgt_epi32(needle, _mm256_loadu_si256((const __m256i*)(keys + i)));
+        less += __builtin_popcount(_mm256_movemask_ps(_mm256_castsi256_ps(m)));
+    }
+    for (; i < count; i++)
+        less += keys[i] < key;
+    return less;
+}
+#endif
+
+// Pick the widest kernel supported by the running CPU
+inline NodeSearchFn selectNodeSearch() {
+#ifdef NODE_SEARCH_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2"))
+        return nodeCountLessAVX2;
+    if (__builtin_cpu_supports("sse2"))
+        return nodeCountLessSSE2;
+#endif
+    return nodeCountLessScalar;
+}
+
+inline const NodeSearchFn nodeCountLess = selectNodeSearch();
+
+// Number of lookups whose descents searchBatch() interleaves. Enough
+// independent misses in flight to cover DRAM latency without the cursor
+// arrays spilling out of registers and L1.
+const int SEARCH_BATCH_GROUP = 16;
+
+// Prefetch every cache line of [p, p + bytes) for reading
+inline void prefetchRange(const void* p, size_t bytes) {
+    const char* c = static_cast<const char*>(p);
+    for (size_t off = 0; off < bytes; off += 64)
+        __builtin_prefetch(c + off);
+}
+
+// First position whose key is >= key
+inline int nodeLowerBound(const int* keys, int count, int key) {
+    return nodeCountLess(keys, count, key);
+}
+
+// First position whose key is > key
+inline int nodeUpperBound(const int* keys, int count, int key) {
+    return key == INT_MAX ? count : nodeCountLess(keys, count, key + 1);
+}
+
+#endif
@@ -2,6 +2,10 @@
 #define RECORD_H
 
 #include<iostream>
+#include<string>
+#include<string_view>
+#include<utility>
+#include<cstring>
 
 class Record {
     public:
@@ -10,8 +14,42 @@ class Record {
     int age;
 
 
-    Record(int _id=0, std::string _name="", int _age=0) : id(_id), name(_name), age(_age) {}
+    Record(int _id=0, std::string _name="", int _age=0) : id(_id), name(std::move(_name)), age(_age) {}
 };
 
 
-#endif
\ No newline at end of file
+// Fixed-size alternative to Record for short name codes. The name lives in
+// an inline NUL-terminated buffer (longer names are truncated) and age is a
+// single byte, so a record is 16 bytes, 16-byte aligned, never touches the
+// heap and is trivially copyable. All trees accept either layout.
+class alignas(16) CompactRecord {
+    public:
+    static const int NAME_CAPACITY = 10;
+
+    int id;
+    unsigned char age;
+    char name[NAME_CAPACITY + 1];
+
+
+    CompactRecord(int _id=0, std::string_view _name="", int _age=0) : id(_id), age((unsigned char)_age) {
+        size_t n = _name.size() < (size_t)NAME_CAPACITY ? _name.size() : (size_t)NAME_CAPACITY;
+        std::memcpy(name, _name.data(), n);
+        std::memset(name + n, 0, sizeof(name) - n);
+    }
+
+    explicit CompactRecord(const Record& rec) : CompactRecord(rec.id, rec.name, rec.age) {}
+};
+
+static_assert(sizeof(CompactRecord) == 16, "CompactRecord should pack into 16 bytes");
+
+
+inline std::ostream& operator<<(std::ostream& os, const Record& rec) {
+    return os << "ID: " << rec.id << ", Name: " << rec.name << ", Age: " << rec.age;
+}
+
+inline std::ostream& operator<<(std::ostream& os, const CompactRecord& rec) {
+    return os << "ID: " << rec.id << ", Name: " << rec.name << ", Age: " << (int)rec.age;
+}
+
+
+#endif
@@ -3,36 +3,85 @@
 
 #include <iostream>
 #include "RECORD.h"
+#include "NODE_ARENA.h"
+#include "NODE_SEARCH.h"
+#include "BULK_LOAD.h"
+#include "INDEX_POLICY.h"
+#include "RECORD_FROZEN.h"
+#include "RECORD_STATS.h"
 #include <iostream>
+#include <memory>
 #include <string>
+#include <thread>
+#include <vector>
 
 
 // AVLNode class representing a single node in the AVL tree
-class AVLNode {
+template<typename RecordT>
+class BasicAVLNode {
 public:
-    Record rec;
-    AVLNode* left;
-    AVLNode* right;
+    RecordT rec;
+    BasicAVLNode* left;
+    BasicAVLNode* right;
     int height;
+    long size;                   // Number of records in the subtree rooted here
 
-    AVLNode(Record _rec = Record()) {
-        rec = _rec;
+    BasicAVLNode(RecordT _rec = RecordT()) : rec(std::move(_rec)) {
         left = nullptr;
         right = nullptr;
         height = 1;
+        size = 1;
     }
 };
 
-// AVL class encapsulating the AVL tree
-class AVL {
+// AVL class encapsulating the AVL tree, storing Record, CompactRecord or any
+// record type KeyOf can extract a key from
+template<typename RecordT, typename KeyOf = RecordId, typename Compare = std::less<IndexKey<RecordT, KeyOf>>>
+class BasicAVL {
+public:
+    typedef RecordT RecordType;
+    typedef IndexKey<RecordT, KeyOf> KeyType;
+
 private:
+    typedef BasicAVLNode<RecordT> AVLNode;
+
+    // An AVL tree of height h has at least fib(h + 2) - 1 nodes, so 96
+    // levels covers any tree that fits in a 64-bit address space
+    static const int MAX_HEIGHT = 96;
+
     AVLNode* root;
+    // Owns every node; freed chunk by chunk with the last tree using it. Trees
+    // made by split() share their source's arena.
+    std::shared_ptr<NodeArena<AVLNode>> arena;
+#ifdef RECORD_STATS
+    mutable IndexStats counters;
+#endif
+
+    // Helper functions to apply the key policies
+    static decltype(auto) keyOf(const RecordT& rec) {
+        return KeyOf()(rec);
+    }
+
+    static bool less(const KeyType& a, const KeyType& b) {
+        return Compare()(a, b);
+    }
 
     // Helper function to calculate height
     int height(AVLNode* node) {
         return node == nullptr ? 0 : node->height;
     }
 
+    // Helper function to get the number of records under a node
+    static long subtreeSize(const AVLNode* node) {
+        return node == nullptr ? 0 : node->size;
+    }
+
+    // Helper function to recompute a node's height and size from its children
+    void updateNode(AVLNode* node) {
+        node->height = 1 + std::max(height(node->left), height(node->right));
+        node->size = 1 + subtreeSize(node->left) + subtreeSize(node->right);
+    }
+
     // Helper function to get the balance factor of a node
     int getBalanceFactor(AVLNode* node) {
         return node == nullptr ? 0 : height(node->left) - height(node->right);
@@ -40,6 +89,7 @@ private:
 
     // Helper function to perform right rotation
     AVLNode* rightRotate(AVLNode* y) {
+        RECORD_STATS_ONLY(counters.rotations++;)
         AVLNode* x = y->left;
         AVLNode* T2 = x->right;
 
@@ -47,15 +97,16 @@ private:
         x->right = y;
         y->left = T2;
 
-        // Update heights
-        y->height = 1 + std::max(height(y->left), height(y->right));
-        x->height = 1 + std::max(height(x->left), height(x->right));
+        // Update heights and sizes
+        updateNode(y);
+        updateNode(x);
 
         return x;
     }
 
     // Helper function to perform left rotation
     AVLNode* leftRotate(AVLNode* x) {
+        RECORD_STATS_ONLY(counters.rotations++;)
         AVLNode* y = x->right;
         AVLNode* T2 = y->left;
 
@@ -63,9 +114,9 @@ private:
         y->left = x;
         x->right = T2;
 
-        // Update heights
-        x->height = 1 + std::max(height(x->left), height(x->right));
-        y->height = 1 + std::max(height(y->left), height(y->right));
+        // Update heights and sizes
+        updateNode(x);
+        updateNode(y);
 
         return y;
     }
@@ -97,94 +148,711 @@ private:
         return node; // Balanced
     }
 
-    // Helper function to insert a node
-    AVLNode* insertAVLNode(AVLNode* node, Record rec) {
-        if (node == nullptr) return new AVLNode(rec);
-
-        if (rec.id < node->rec.id)
-            node->left = insertAVLNode(node->left, rec);
-        else if (rec.id > node->rec.id)
-            node->right = insertAVLNode(node->right, rec);
-        else
-            return node; // Duplicate ID, no insertion
+    // Helper function to update heights and rebalance bottom-up along a path
+    // of child links. Rebalancing stops once a subtree's height is unchanged;
+    // the ancestors above that only need their sizes refreshed.
+    void rebalancePath(AVLNode** path[], int depth) {
+        while (depth-- > 0) {
+            AVLNode* node = *path[depth];
+            int oldHeight = node->height;
+            updateNode(node);
+            node = balanceAVL(node);
+            *path[depth] = node;
+            if (node->height == oldHeight)
+                break;
+        }
+        while (depth-- > 0)
+            updateNode(*path[depth]);
+    }
 
-        // Update height and balance
-        node->height = 1 + std::max(height(node->left), height(node->right));
-        return balanceAVL(node);
+    // Helper function to count the records with a key below key, or not above it if inclusive
+    long countBelow(const KeyType& key, bool inclusive) const {
+        long count = 0;
+        const AVLNode* node = root;
+        while (node != nullptr) {
+            if (inclusive ? !less(key, keyOf(node->rec)) : less(keyOf(node->rec), key)) {
+                count += subtreeSize(node->left) + 1;
+                node = node->right;
+            } else {
+                node = node->left;
+            }
+        }
+        return count;
     }
 
-    // Helper function to find the node with minimum value
-    AVLNode* AVLNodeWithMinimumValue(AVLNode* node) {
-        AVLNode* current = node;
-        while (current && current->left != nullptr)
-            current = current->left;
-        return current;
+    // Helper function to insert a node. The record is only copied or moved
+    // once, into the new node.
+    template<typename R>
+    void insertAVLNode(R&& rec) {
+        RECORD_STATS_ONLY(StatsTimer timer(counters.insertLatency);)
+        AVLNode** path[MAX_HEIGHT];
+        int depth = 0;
+
+        const KeyType& key = keyOf(rec);
+        AVLNode** link = &root;
+        while (*link != nullptr) {
+            path[depth++] = link;
+            if (less(key, keyOf((*link)->rec)))
+                link = &(*link)->left;
+            else if (less(keyOf((*link)->rec), key))
+                link = &(*link)->right;
+            else
+                return; // Duplicate key, no insertion
+        }
+
+        *link = arena->create(std::forward<R>(rec));
+        rebalancePath(path, depth);
     }
 
     // Helper function to delete a node
-    AVLNode* deleteAVLNode(AVLNode* node, int ID) {
-        if (node == nullptr) return node;
+    void deleteAVLNode(const KeyType& key) {
+        RECORD_STATS_ONLY(StatsTimer timer(counters.removeLatency);)
+        AVLNode** path[MAX_HEIGHT];
+        int depth = 0;
+
+        AVLNode** link = &root;
+        while (*link != nullptr) {
+            bool goLeft = less(key, keyOf((*link)->rec));
+            if (!goLeft && !less(keyOf((*link)->rec), key))
+                break;
+            path[depth++] = link;
+            link = goLeft ? &(*link)->left : &(*link)->right;
+        }
 
-        if (ID < node->rec.id) {
-            node->left = deleteAVLNode(node->left, ID);
-        } else if (ID > node->rec.id) {
-            node->right = deleteAVLNode(node->right, ID);
-        } else {
-            if (node->left == nullptr || node->right == nullptr) {
-                AVLNode* temp = node->left ? node->left : node->right;
-                delete node;
-                return temp;
-            }
+        AVLNode* node = *link;
+        if (node == nullptr)
+            return;
 
-            AVLNode* temp = AVLNodeWithMinimumValue(node->right);
-            node->rec = temp->rec;
-            node->right = deleteAVLNode(node->right, temp->rec.id);
+        if (node->left == nullptr || node->right == nullptr) {
+            *link = node->left ? node->left : node->right;
+            arena->destroy(node);
+            rebalancePath(path, depth);
+            return;
         }
 
-        // Update height and balance
-        node->height = 1 + std::max(height(node->left), height(node->right));
-        return balanceAVL(node);
+        // Two children: replace with the in-order successor and unlink it instead
+        path[depth++] = link;
+        AVLNode** minLink = &node->right;
+        while ((*minLink)->left != nullptr) {
+            path[depth++] = minLink;
+            minLink = &(*minLink)->left;
+        }
+
+        AVLNode* temp = *minLink;
+        node->rec = std::move(temp->rec);
+        *minLink = temp->right;
+        arena->destroy(temp);
+        rebalancePath(path, depth);
     }
 
     // Helper function to search for a node
-    AVLNode* searchAVLNode(AVLNode* node, int ID) {
-        if (node == nullptr || node->rec.id == ID)
-            return node;
+    AVLNode* searchAVLNode(AVLNode* node, const KeyType& key) {
+        RECORD_STATS_ONLY(StatsTimer timer(counters.searchLatency); uint64_t before = counters.nodesVisited;)
+        while (node != nullptr) {
+            RECORD_STATS_ONLY(counters.nodesVisited++;)
+            if (less(key, keyOf(node->rec)))
+                node = node->left;
+            else if (less(keyOf(node->rec), key))
+                node = node->right;
+            else
+                break;
+        }
+        RECORD_STATS_ONLY(recordSearchVisits(counters, before);)
+        return node;
+    }
 
-        if (ID < node->rec.id)
-            return searchAVLNode(node->left, ID);
-        else
-            return searchAVLNode(node->right, ID);
+    // Helper function to copy out all records in order without recursion
+    std::vector<RecordT> collectRecords() const {
+        std::vector<RecordT> recs;
+        std::vector<AVLNode*> stack;
+        AVLNode* node = root;
+        while (node != nullptr || !stack.empty()) {
+            while (node != nullptr) {
+                stack.push_back(node);
+                node = node->left;
+            }
+            node = stack.back();
+            stack.pop_back();
+            recs.push_back(node->rec);
+            node = node->right;
+        }
+        return recs;
+    }
+
+    // Helper function to build a perfectly balanced tree from sorted records
+    AVLNode* buildBalanced(std::vector<RecordT>& recs, long lo, long hi) {
+        if (lo > hi)
+            return nullptr;
+        long mid = lo + (hi - lo) / 2;
+        AVLNode* node = arena->create(std::move(recs[mid]));
+        node->left = buildBalanced(recs, lo, mid - 1);
+        node->right = buildBalanced(recs, mid + 1, hi);
+        updateNode(node);
+        return node;
     }
 
     // Helper function to print the tree in-order
     void printTreeInOrder(AVLNode* node) {
         if (node) {
             printTreeInOrder(node->left);
-            std::cout << "ID: " << node->rec.id << ", Name: " << node->rec.name << ", Age: " << node->rec.age << std::endl;
+            std::cout << node->rec << std::endl;
             printTreeInOrder(node->right);
         }
     }
 
+    // Helper function to destroy every node of a detached subtree
+    void destroySubtree(AVLNode* node) {
+        std::vector<AVLNode*> stack;
+        if (node)
+            stack.push_back(node);
+        while (!stack.empty()) {
+            node = stack.back();
+            stack.pop_back();
+            if (node->left)
+                stack.push_back(node->left);
+            if (node->right)
+                stack.push_back(node->right);
+            arena->destroy(node);
+        }
+    }
+
+    // Helper function to drop every node, returning whole chunks at once
+    // unless another tree still uses the arena
+    void releaseNodes() {
+        if (arena.use_count() == 1)
+            arena->clear();
+        else
+            destroySubtree(root);
+        root = nullptr;
+    }
+
+    // Join-based set operations, after Blelloch, Ferizovic and Sun, "Just
+    // Join for Parallel Ordered Sets" (SPAA 2016). Everything is built from
+    // join(l, k, r), which links two trees and a middle node whose key lies
+    // between them in O(|height(l) - height(r)|). The operations relink the
+    // existing nodes instead of copying records; nodes they discard are
+    // collected in a garbage list and destroyed once the parallel part is
+    // over, since the arena is not thread-safe.
+
+    // Subtrees smaller than this are never forked onto another thread
+    static const long PARALLEL_GRAIN = 1 << 14;
+
+    // Helper function to join l, k and r when l is the taller tree
+    AVLNode* joinRight(AVLNode* l, AVLNode* k, AVLNode* r) {
+        if (height(l) <= height(r) + 1) {
+            k->left = l;
+            k->right = r;
+            updateNode(k);
+            return k;
+        }
+        l->right = joinRight(l->right, k, r);
+        updateNode(l);
+        return balanceAVL(l);
+    }
+
+    // Helper function to join l, k and r when r is the taller tree
+    AVLNode* joinLeft(AVLNode* l, AVLNode* k, AVLNode* r) {
+        if (height(r) <= height(l) + 1) {
+            k->left = l;
+            k->right = r;
+            updateNode(k);
+            return k;
+        }
+        r->left = joinLeft(l, k, r->left);
+        updateNode(r);
+        return balanceAVL(r);
+    }
+
+    // Helper function to join two trees and a node, all keys of l < k's key < all keys of r
+    AVLNode* join(AVLNode* l, AVLNode* k, AVLNode* r) {
+        if (height(l) > height(r) + 1)
+            return joinRight(l, k, r);
+        if (height(r) > height(l) + 1)
+            return joinLeft(l, k, r);
+        k->left = l;
+        k->right = r;
+        updateNode(k);
+        return k;
+    }
+
+    // Helper function to detach the largest node of a non-empty tree
+    AVLNode* splitLast(AVLNode* node, AVLNode*& last) {
+        if (node->right == nullptr) {
+            last = node;
+            AVLNode* rest = node->left;
+            node->left = nullptr;
+            return rest;
+        }
+        node->right = splitLast(node->right, last);
+        updateNode(node);
+        return balanceAVL(node);
+    }
+
+    // Helper function to join two trees without a middle node
+    AVLNode* join2(AVLNode* l, AVLNode* r) {
+        if (l == nullptr)
+            return r;
+        AVLNode* last;
+        l = splitLast(l, last);
+        return join(l, last, r);
+    }
+
+    // Helper function to split a tree into the keys below key (l) and above
+    // it (r). Returns the detached node holding key, or nullptr.
+    AVLNode* splitAt(AVLNode* node, const KeyType& key, AVLNode*& l, AVLNode*& r) {
+        if (node == nullptr) {
+            l = r = nullptr;
+            return nullptr;
+        }
+        AVLNode* left = node->left;
+        AVLNode* right = node->right;
+        if (less(key, keyOf(node->rec))) {
+            AVLNode* middle;
+            AVLNode* found = splitAt(left, key, l, middle);
+            r = join(middle, node, right);
+            return found;
+        }
+        if (less(keyOf(node->rec), key)) {
+            AVLNode* middle;
+            AVLNode* found = splitAt(right, key, middle, r);
+            l = join(left, node, middle);
+            return found;
+        }
+        l = left;
+        r = right;
+        node->left = node->right = nullptr;
+        return node;
+    }
+
+    // Helper function to run the two independent halves of a set operation:
+    // the left one on a new thread while forks remain and the subtrees are
+    // big enough, otherwise one after the other. Each half gets its own
+    // garbage list when they run in parallel.
+    template<typename Op>
+    void forkJoin(Op op, AVLNode* al, AVLNode* bl, AVLNode* ar, AVLNode* br, int forks,
+                  std::vector<AVLNode*>& garbage, AVLNode*& l, AVLNode*& r) {
+        if (forks > 0 && !RECORD_STATS_ENABLED && subtreeSize(al) + subtreeSize(bl) >= PARALLEL_GRAIN) {
+            std::vector<AVLNode*> leftGarbage;
+            std::thread worker([&]() { l = (this->*op)(al, bl, forks - 1, leftGarbage); });
+            r = (this->*op)(ar, br, forks - 1, garbage);
+            worker.join();
+            garbage.insert(garbage.end(), leftGarbage.begin(), leftGarbage.end());
+        } else {
+            l = (this->*op)(al, bl, forks - 1, garbage);
+            r = (this->*op)(ar, br, forks - 1, garbage);
+        }
+    }
+
+    // Helper function for unionWith; on equal keys the node of a is kept
+    AVLNode* unionNodes(AVLNode* a, AVLNode* b, int forks, std::vector<AVLNode*>& garbage) {
+        if (a == nullptr)
+            return b;
+        if (b == nullptr)
+            return a;
+        AVLNode *bl, *br;
+        AVLNode* dup = splitAt(b, keyOf(a->rec), bl, br);
+        if (dup)
+            garbage.push_back(dup);
+        AVLNode *al = a->left, *ar = a->right, *l, *r;
+        forkJoin(&BasicAVL::unionNodes, al, bl, ar, br, forks, garbage, l, r);
+        return join(l, a, r);
+    }
+
+    // Helper function for intersect; keeps the nodes of a
+    AVLNode* intersectNodes(AVLNode* a, AVLNode* b, int forks, std::vector<AVLNode*>& garbage) {
+        if (a == nullptr || b == nullptr) {
+            if (a)
+                garbage.push_back(a);
+            if (b)
+                garbage.push_back(b);
+            return nullptr;
+        }
+        AVLNode *bl, *br;
+        AVLNode* dup = splitAt(b, keyOf(a->rec), bl, br);
+        AVLNode *al = a->left, *ar = a->right, *l, *r;
+        a->left = a->right = nullptr;
+        forkJoin(&BasicAVL::intersectNodes, al, bl, ar, br, forks, garbage, l, r);
+        if (dup) {
+            garbage.push_back(dup);
+            return join(l, a, r);
+        }
+        garbage.push_back(a);
+        return join2(l, r);
+    }
+
+    // Helper function for difference: the nodes of a whose key is not in b
+    AVLNode* differenceNodes(AVLNode* a, AVLNode* b, int forks, std::vector<AVLNode*>& garbage) {
+        if (a == nullptr || b == nullptr) {
+            if (b)
+                garbage.push_back(b);
+            return a;
+        }
+        AVLNode *al, *ar;
+        AVLNode* dup = splitAt(a, keyOf(b->rec), al, ar);
+        if (dup)
+            garbage.push_back(dup);
+        AVLNode *bl = b->left, *br = b->right, *l, *r;
+        b->left = b->right = nullptr;
+        garbage.push_back(b);
+        forkJoin(&BasicAVL::differenceNodes, al, bl, ar, br, forks, garbage, l, r);
+        return join2(l, r);
+    }
+
+    // Helper function to move other's nodes into this tree's arena, so one
+    // tree owns them all. Free when the arenas are already shared, or when
+    // other's arena is its own and its chunks can be adopted whole; if other
+    // shares its arena with a third tree, its records are copied.
+    void absorbArena(BasicAVL& other) {
+        if (other.arena == arena)
+            return;
+        if (other.arena.use_count() == 1) {
+            arena->adopt(*other.arena);
+            return;
+        }
+        std::vector<RecordT> recs = other.collectRecords();
+        other.releaseNodes();
+        other.root = buildBalanced(recs, 0, (long)recs.size() - 1);
+        other.arena = arena;
+    }
+
+    // Helper function to pick the fork depth: enough forks for every thread
+    static int forkDepth(int threads) {
+        if (threads <= 0)
+            threads = (int)std::thread::hardware_concurrency();
+        int depth = 0;
+        while ((1 << depth) < threads)
+            depth++;
+        return depth;
+    }
+
+    // Helper function to run one set operation against other, leaving other
+    // empty. A tree combined with itself is left as it is, which is the
+    // result of union and intersection; difference handles that case itself.
+    template<typename Op>
+    void combine(BasicAVL& other, int threads, Op op) {
+        if (&other == this)
+            return;
+        absorbArena(other);
+        std::vector<AVLNode*> garbage;
+        root = (this->*op)(root, other.root, forkDepth(threads), garbage);
+        other.root = nullptr;
+        for (AVLNode* node : garbage)
+            destroySubtree(node);
+    }
+
+    explicit BasicAVL(std::shared_ptr<NodeArena<AVLNode>> shared) : root(nullptr), arena(std::move(shared)) {}
+
 public:
-    AVL() : root(nullptr) {}
+    // Bidirectional in-order cursor. It keeps the path from the root, so it
+    // takes O(height) space and no parent links are needed. Stepping past
+    // either end leaves it invalid; any insert or remove invalidates it.
+    class Cursor {
+    private:
+        friend class BasicAVL;
+
+        const AVLNode* path[MAX_HEIGHT];
+        int depth = 0;
+
+        void pushLeftSpine(const AVLNode* node) {
+            for (; node != nullptr; node = node->left)
+                path[depth++] = node;
+        }
+
+        void pushRightSpine(const AVLNode* node) {
+            for (; node != nullptr; node = node->right)
+                path[depth++] = node;
+        }
+
+    public:
+        bool valid() const {
+            return depth > 0;
+        }
+
+        const RecordT& operator*() const {
+            return path[depth - 1]->rec;
+        }
+
+        const RecordT* operator->() const {
+            return &path[depth - 1]->rec;
+        }
+
+        // Step to the next larger key
+        void next() {
+            const AVLNode* node = path[depth - 1];
+            if (node->right != nullptr) {
+                pushLeftSpine(node->right);
+                return;
+            }
+            depth--;
+            while (depth > 0 && path[depth - 1]->right == node)
+                node = path[--depth];
+        }
+
+        // Step to the next smaller key
+        void prev() {
+            const AVLNode* node = path[depth - 1];
+            if (node->left != nullptr) {
+                pushRightSpine(node->left);
+                return;
+            }
+            depth--;
+            while (depth > 0 && path[depth - 1]->left == node)
+                node = path[--depth];
+        }
+    };
+
+    BasicAVL() : root(nullptr), arena(std::make_shared<NodeArena<AVLNode>>()) {}
 
-    void insert(Record rec) {
-        root = insertAVLNode(root, rec);
+    // Takes other's nodes; other is left empty with an arena of its own
+    BasicAVL(BasicAVL&& other) : root(other.root), arena(std::move(other.arena)) {
+        other.root = nullptr;
+        other.arena = std::make_shared<NodeArena<AVLNode>>();
     }
 
-    void remove(int ID) {
-        root = deleteAVLNode(root, ID);
+    // A tree sharing its arena frees its own nodes; otherwise the arena goes with it
+    ~BasicAVL() {
+        if (arena.use_count() > 1)
+            destroySubtree(root);
     }
 
-    Record* search(int ID) {
-        AVLNode* result = searchAVLNode(root, ID);
+    BasicAVL(const BasicAVL&) = delete;
+    BasicAVL& operator=(const BasicAVL&) = delete;
+
+    void insert(const RecordT& rec) {
+        insertAVLNode(rec);
+    }
+
+    void insert(RecordT&& rec) {
+        insertAVLNode(std::move(rec));
+    }
+
+    // Construct the record from its constructor arguments and move it in
+    template<typename... Args>
+    void emplace(Args&&... args) {
+        insertAVLNode(RecordT(std::forward<Args>(args)...));
+    }
+
+    // Build the tree bottom-up from a range of records in O(n) (plus a sort
+    // if the input is not already ordered by key). Records already in the
+    // tree are kept, and duplicate keys resolve as if inserted one by one.
+    template<typename It>
+    void bulkLoad(It first, It last) {
+        std::vector<RecordT> recs = mergeSortedRecords<KeyOf, Compare>(collectRecords(),
+                                                                       sortedUniqueRecords<RecordT, KeyOf, Compare>(first, last));
+        releaseNodes();
+        root = buildBalanced(recs, 0, (long)recs.size() - 1);
+    }
+
+    // Move the records with keys >= key into a new tree, keeping the smaller
+    // ones here, in O(log n). The two trees share one node arena, so neither
+    // may be modified while the other is in use on another thread.
+    BasicAVL split(const KeyType& key) {
+        BasicAVL upper(arena);
+        AVLNode *l, *r;
+        AVLNode* middle = splitAt(root, key, l, r);
+        root = l;
+        upper.root = middle ? join(nullptr, middle, r) : r;
+        return upper;
+    }
+
+    // Append other, whose keys must all be greater than this tree's, in
+    // O(log n) once the nodes share an arena; other is left empty
+    void join(BasicAVL& other) {
+        if (&other == this || other.root == nullptr)
+            return;
+        absorbArena(other);
+        if (root != nullptr) {
+            // The largest node here becomes the middle node of the join
+            AVLNode* last;
+            root = splitLast(root, last);
+            root = join(root, last, other.root);
+        } else {
+            root = other.root;
+        }
+        other.root = nullptr;
+    }
+
+    // Merge other into this tree, leaving other empty; for a key in both
+    // trees this tree's record is kept, as with insert. Runs in
+    // O(m log(n / m + 1)) work for trees of sizes m <= n, forking the
+    // independent halves of the recursion onto up to `threads` threads
+    // (0: one per core).
+    void unionWith(BasicAVL& other, int threads = 0) {
+        combine(other, threads, &BasicAVL::unionNodes);
+    }
+
+    // Keep only the records whose key is also in other; other is left empty
+    void intersect(BasicAVL& other, int threads = 0) {
+        combine(other, threads, &BasicAVL::intersectNodes);
+    }
+
+    // Remove the records whose key is in other; other is left empty. The
+    // difference of a tree with itself empties it.
+    void difference(BasicAVL& other, int threads = 0) {
+        if (&other == this) {
+            releaseNodes();
+            return;
+        }
+        combine(other, threads, &BasicAVL::differenceNodes);
+    }
+
+    // Look up n keys at once, storing each record (or nullptr) in out. The
+    // descents of a group of keys advance in lockstep and every step
+    // prefetches the next node, so the cache misses of the group overlap
+    // instead of being paid one after another.
+    void searchBatch(const KeyType* keys, size_t n, RecordT** out) {
+        AVLNode* cursor[SEARCH_BATCH_GROUP];
+        for (size_t base = 0; base < n; base += SEARCH_BATCH_GROUP) {
+            int group = n - base < (size_t)SEARCH_BATCH_GROUP ? (int)(n - base) : SEARCH_BATCH_GROUP;
+            for (int g = 0; g < group; g++) {
+                cursor[g] = root;
+                out[base + g] = nullptr;
+            }
+
+            int active = group;
+            while (active > 0) {
+                active = 0;
+                for (int g = 0; g < group; g++) {
+                    AVLNode* node = cursor[g];
+                    if (node == nullptr)
+                        continue;
+
+                    const KeyType& key = keys[base + g];
+                    bool goLeft = less(key, keyOf(node->rec));
+                    if (!goLeft && !less(keyOf(node->rec), key)) {
+                        out[base + g] = &node->rec;
+                        cursor[g] = nullptr;
+                        continue;
+                    }
+
+                    node = goLeft ? node->left : node->right;
+                    cursor[g] = node;
+                    if (node != nullptr) {
+                        __builtin_prefetch(node);
+                        active++;
+                    }
+                }
+            }
+        }
+    }
+
+    void remove(const KeyType& key) {
+        deleteAVLNode(key);
+    }
+
+    RecordT* search(const KeyType& key) {
+        AVLNode* result = searchAVLNode(root, key);
         return result ? &result->rec : nullptr;
     }
 
     void print() {
         printTreeInOrder(root);
     }
+
+    // Number of records in the tree
+    long size() const {
+        return subtreeSize(root);
+    }
+
+    // Number of records whose key is smaller than key, i.e. the position key
+    // has or would have in sorted order
+    long rank(const KeyType& key) const {
+        return countBelow(key, false);
+    }
+
+    // The record at position k (0-based) in key order, or nullptr if k is out of range
+    RecordT* select(long k) {
+        if (k < 0 || k >= size())
+            return nullptr;
+        AVLNode* node = root;
+        while (true) {
+            long leftSize = subtreeSize(node->left);
+            if (k == leftSize)
+                return &node->rec;
+            if (k < leftSize) {
+                node = node->left;
+            } else {
+                k -= leftSize + 1;
+                node = node->right;
+            }
+        }
+    }
+
+    // Number of records with lo <= key <= hi
+    long countRange(const KeyType& lo, const KeyType& hi) const {
+        return less(hi, lo) ? 0 : countBelow(hi, true) - countBelow(lo, false);
+    }
+
+    // Cursor at the smallest key
+    Cursor first() const {
+        Cursor c;
+        c.pushLeftSpine(root);
+        return c;
+    }
+
+    // Cursor at the largest key
+    Cursor last() const {
+        Cursor c;
+        c.pushRightSpine(root);
+        return c;
+    }
+
+    // Cursor at the first record whose key is not less than key
+    Cursor lowerBound(const KeyType& key) const {
+        Cursor c;
+        const AVLNode* node = root;
+        while (node != nullptr) {
+            c.path[c.depth++] = node;
+            if (less(key, keyOf(node->rec)))
+                node = node->left;
+            else if (less(keyOf(node->rec), key))
+                node = node->right;
+            else
+                return c;
+        }
+        // The search ended below the last node on the path; if that node is
+        // smaller than key, its successor is the answer
+        if (c.valid() && less(keyOf(*c), key))
+            c.next();
+        return c;
+    }
+
+    // Call fn(const RecordT&) on every record with lo <= key <= hi, in key
+    // order and without copying. Returns the number of records visited.
+    template<typename Fn>
+    size_t rangeScan(const KeyType& lo, const KeyType& hi, Fn&& fn) const {
+        size_t count = 0;
+        for (Cursor c = lowerBound(lo); c.valid() && !less(hi, keyOf(*c)); c.next(), count++)
+            fn(*c);
+        return count;
+    }
+
+    // Copy the records into an immutable snapshot laid out for fast
+    // read-only lookups (see RECORD_FROZEN.h); later updates to the tree
+    // do not affect it
+    BasicFrozenIndex<RecordT, KeyOf, Compare> freeze() const {
+        return BasicFrozenIndex<RecordT, KeyOf, Compare>(collectRecords());
+    }
+
+    ArenaStats arenaStats() const {
+        return arena->stats();
+    }
+
+    // Snapshot of the instrumentation counters; empty unless built with -DRECORD_STATS
+    IndexStats stats() const {
+#ifdef RECORD_STATS
+        return counters;
+#else
+        return IndexStats();
+#endif
+    }
+
+    void resetStats() {
+        RECORD_STATS_ONLY(counters = IndexStats();)
+    }
 };
 
+typedef BasicAVLNode<Record> AVLNode;
+typedef BasicAVL<Record> AVL;
+
 #endif
\ No newline at end of file
@@ -0,0 +1,660 @@
+#ifndef RECORD_BPTREE_H
+#define RECORD_BPTREE_H
+
+#include <iostream>
+#include <utility>
+#include <vector>
+#include "RECORD.h"
+#include "BULK_LOAD.h"
+#include "RECORD_STATS.h"
+#include "NODE_SEARCH.h"
+#include "NODE_ARENA.h"
+
+// Fan-out of the B+Tree. Internal nodes only hold packed int ids and child
+// pointers, so a 64-key node is 256 bytes of keys followed by its children in
+// the same allocation; leaves keep their ids in a separate array from the
+// records so the intra-node probe never touches the names.
+const int BPTREE_INNER_KEYS = 64;
+const int BPTREE_LEAF_RECORDS = 32;
+
+// Common header shared by internal nodes and leaves
+class BPTreeNode {
+public:
+    bool isLeaf;
+    int count;                   // Number of keys (inner) or records (leaf)
+
+    BPTreeNode(bool _isLeaf) : isLeaf(_isLeaf), count(0) {}
+};
+
+// Internal node: separator ids and child pointers, nothing else
+class BPTreeInner : public BPTreeNode {
+public:
+    int keys[BPTREE_INNER_KEYS];                  // keys[i] <= every id in children[i + 1]
+    BPTreeNode* children[BPTREE_INNER_KEYS + 1];
+
+    BPTreeInner() : BPTreeNode(false) {}
+};
+
+// Leaf node: sorted ids, the matching records, and sibling links
+template<typename RecordT>
+class BasicBPTreeLeaf : public BPTreeNode {
+public:
+    int ids[BPTREE_LEAF_RECORDS];
+    RecordT records[BPTREE_LEAF_RECORDS];
+    BasicBPTreeLeaf* prev;
+    BasicBPTreeLeaf* next;
+
+    BasicBPTreeLeaf() : BPTreeNode(true), prev(nullptr), next(nullptr) {}
+};
+
+// BPTree class encapsulating the B+Tree, storing Record or CompactRecord
+template<typename RecordT>
+class BasicBPTree {
+public:
+    typedef RecordT RecordType;
+    typedef int KeyType;
+
+private:
+    typedef BasicBPTreeLeaf<RecordT> BPTreeLeaf;
+
+    BPTreeNode* root;
+    NodeArena<BPTreeInner> inners;   // Per-type arenas owning every node
+    NodeArena<BPTreeLeaf> leaves;
+#ifdef RECORD_STATS
+    mutable IndexStats counters;
+#endif
+
+    static const int MIN_INNER_KEYS = (BPTREE_INNER_KEYS - 1) / 2;
+    static const int MIN_LEAF_RECORDS = BPTREE_LEAF_RECORDS / 2;
+
+    // Helper function to find the leaf that would hold the given id
+    BPTreeLeaf* findLeaf(int ID) const {
+        BPTreeNode* node = root;
+        while (node != nullptr && !node->isLeaf) {
+            RECORD_STATS_ONLY(counters.nodesVisited++;)
+            BPTreeInner* inner = static_cast<BPTreeInner*>(node);
+            node = inner->children[nodeUpperBound(inner->keys, inner->count, ID)];
+        }
+        RECORD_STATS_ONLY(if (node) counters.nodesVisited++;)
+        return static_cast<BPTreeLeaf*>(node);
+    }
+
+    // Helper function to find the leftmost leaf
+    BPTreeLeaf* firstLeaf() const {
+        BPTreeNode* node = root;
+        while (node != nullptr && !node->isLeaf)
+            node = static_cast<BPTreeInner*>(node)->children[0];
+        return static_cast<BPTreeLeaf*>(node);
+    }
+
+    // Helper function to insert into a leaf with free space
+    template<typename R>
+    static void insertIntoLeaf(BPTreeLeaf* leaf, int pos, R&& rec) {
+        for (int j = leaf->count; j > pos; j--) {
+            leaf->ids[j] = leaf->ids[j - 1];
+            leaf->records[j] = std::move(leaf->records[j - 1]);
+        }
+        leaf->ids[pos] = rec.id;
+        leaf->records[pos] = std::forward<R>(rec);
+        leaf->count++;
+    }
+
+    // Helper function to insert a separator and its right child into an inner node with free space
+    static void insertIntoInner(BPTreeInner* inner, int pos, int key, BPTreeNode* child) {
+        for (int j = inner->count; j > pos; j--) {
+            inner->keys[j] = inner->keys[j - 1];
+            inner->children[j + 1] = inner->children[j];
+        }
+        inner->keys[pos] = key;
+        inner->children[pos + 1] = child;
+        inner->count++;
+    }
+
+    // Helper function for insertion. Returns the new right sibling if the node
+    // split, storing the separator to push up in upKey. The record is only
+    // copied or moved once, into its leaf slot.
+    template<typename R>
+    BPTreeNode* insertNode(BPTreeNode* node, R&& rec, int& upKey) {
+        if (node->isLeaf) {
+            BPTreeLeaf* leaf = static_cast<BPTreeLeaf*>(node);
+            int pos = nodeLowerBound(leaf->ids, leaf->count, rec.id);
+            if (pos < leaf->count && leaf->ids[pos] == rec.id)
+                return nullptr; // Duplicate ID, no insertion
+
+            if (leaf->count < BPTREE_LEAF_RECORDS) {
+                insertIntoLeaf(leaf, pos, std::forward<R>(rec));
+                return nullptr;
+            }
+
+            // Split the full leaf in half, then insert into the proper side
+            RECORD_STATS_ONLY(counters.splits++;)
+            int half = BPTREE_LEAF_RECORDS / 2;
+            BPTreeLeaf* right = leaves.create();
+            for (int j = half; j < leaf->count; j++) {
+                right->ids[j - half] = leaf->ids[j];
+                right->records[j - half] = std::move(leaf->records[j]);
+            }
+            right->count = leaf->count - half;
+            leaf->count = half;
+
+            right->next = leaf->next;
+            right->prev = leaf;
+            if (leaf->next)
+                leaf->next->prev = right;
+            leaf->next = right;
+
+            if (pos <= half)
+                insertIntoLeaf(leaf, pos, std::forward<R>(rec));
+            else
+                insertIntoLeaf(right, pos - half, std::forward<R>(rec));
+
+            upKey = right->ids[0];
+            return right;
+        }
+
+        BPTreeInner* inner = static_cast<BPTreeInner*>(node);
+        int i = nodeUpperBound(inner->keys, inner->count, rec.id);
+        int childKey;
+        BPTreeNode* newChild = insertNode(inner->children[i], std::forward<R>(rec), childKey);
+        if (newChild == nullptr)
+            return nullptr;
+
+        if (inner->count < BPTREE_INNER_KEYS) {
+            insertIntoInner(inner, i, childKey, newChild);
+            return nullptr;
+        }
+
+        // Split the full inner node around its middle key
+        RECORD_STATS_ONLY(counters.splits++;)
+        int mid = BPTREE_INNER_KEYS / 2;
+        BPTreeInner* right = inners.create();
+        for (int j = mid + 1; j < inner->count; j++)
+            right->keys[j - mid - 1] = inner->keys[j];
+        for (int j = mid + 1; j <= inner->count; j++)
+            right->children[j - mid - 1] = inner->children[j];
+        right->count = inner->count - mid - 1;
+        inner->count = mid;
+        upKey = inner->keys[mid];
+
+        if (i <= mid)
+            insertIntoInner(inner, i, childKey, newChild);
+        else
+            insertIntoInner(right, i - mid - 1, childKey, newChild);
+
+        return right;
+    }
+
+    // Helper functions to rebalance an underfull child of an inner node
+    void rebalanceLeaf(BPTreeInner* parent, int i) {
+        BPTreeLeaf* child = static_cast<BPTreeLeaf*>(parent->children[i]);
+        BPTreeLeaf* left = i > 0 ? static_cast<BPTreeLeaf*>(parent->children[i - 1]) : nullptr;
+        BPTreeLeaf* right = i < parent->count ? static_cast<BPTreeLeaf*>(parent->children[i + 1]) : nullptr;
+
+        if (left && left->count > MIN_LEAF_RECORDS) {
+            // Borrow the largest record of the left sibling
+            RECORD_STATS_ONLY(counters.borrows++;)
+            for (int j = child->count; j > 0; j--) {
+                child->ids[j] = child->ids[j - 1];
+                child->records[j] = std::move(child->records[j - 1]);
+            }
+            child->ids[0] = left->ids[left->count - 1];
+            child->records[0] = std::move(left->records[left->count - 1]);
+            child->count++;
+            left->count--;
+            parent->keys[i - 1] = child->ids[0];
+        } else if (right && right->count > MIN_LEAF_RECORDS) {
+            // Borrow the smallest record of the right sibling
+            RECORD_STATS_ONLY(counters.borrows++;)
+            child->ids[child->count] = right->ids[0];
+            child->records[child->count] = std::move(right->records[0]);
+            child->count++;
+            for (int j = 1; j < right->count; j++) {
+                right->ids[j - 1] = right->ids[j];
+                right->records[j - 1] = std::move(right->records[j]);
+            }
+            right->count--;
+            parent->keys[i] = right->ids[0];
+        } else if (left) {
+            mergeLeaves(parent, i - 1);
+        } else if (right) {
+            mergeLeaves(parent, i);
+        }
+    }
+
+    void rebalanceInner(BPTreeInner* parent, int i) {
+        BPTreeInner* child = static_cast<BPTreeInner*>(parent->children[i]);
+        BPTreeInner* left = i > 0 ? static_cast<BPTreeInner*>(parent->children[i - 1]) : nullptr;
+        BPTreeInner* right = i < parent->count ? static_cast<BPTreeInner*>(parent->children[i + 1]) : nullptr;
+
+        if (left && left->count > MIN_INNER_KEYS) {
+            // Rotate the last key and child of the left sibling through the parent
+            RECORD_STATS_ONLY(counters.borrows++;)
+            child->children[child->count + 1] = child->children[child->count];
+            for (int j = child->count; j > 0; j--) {
+                child->keys[j] = child->keys[j - 1];
+                child->children[j] = child->children[j - 1];
+            }
+            child->keys[0] = parent->keys[i - 1];
+            child->children[0] = left->children[left->count];
+            child->count++;
+            parent->keys[i - 1] = left->keys[left->count - 1];
+            left->count--;
+        } else if (right && right->count > MIN_INNER_KEYS) {
+            // Rotate the first key and child of the right sibling through the parent
+            RECORD_STATS_ONLY(counters.borrows++;)
+            child->keys[child->count] = parent->keys[i];
+            child->children[child->count + 1] = right->children[0];
+            child->count++;
+            parent->keys[i] = right->keys[0];
+            for (int j = 1; j < right->count; j++)
+                right->keys[j - 1] = right->keys[j];
+            for (int j = 1; j <= right->count; j++)
+                right->children[j - 1] = right->children[j];
+            right->count--;
+        } else if (left) {
+            mergeInners(parent, i - 1);
+        } else if (right) {
+            mergeInners(parent, i);
+        }
+    }
+
+    // Helper function removing separator i and child i + 1 from an inner node
+    static void removeFromInner(BPTreeInner* parent, int i) {
+        for (int j = i + 1; j < parent->count; j++) {
+            parent->keys[j - 1] = parent->keys[j];
+            parent->children[j] = parent->children[j + 1];
+        }
+        parent->count--;
+    }
+
+    // Helper function to merge leaf i + 1 into leaf i
+    void mergeLeaves(BPTreeInner* parent, int i) {
+        BPTreeLeaf* left = static_cast<BPTreeLeaf*>(parent->children[i]);
+        BPTreeLeaf* right = static_cast<BPTreeLeaf*>(parent->children[i + 1]);
+        RECORD_STATS_ONLY(counters.merges++;)
+
+        for (int j = 0; j < right->count; j++) {
+            left->ids[left->count + j] = right->ids[j];
+            left->records[left->count + j] = std::move(right->records[j]);
+        }
+        left->count += right->count;
+
+        left->next = right->next;
+        if (right->next)
+            right->next->prev = left;
+
+        removeFromInner(parent, i);
+        leaves.destroy(right);
+    }
+
+    // Helper function to merge inner node i + 1 into inner node i
+    void mergeInners(BPTreeInner* parent, int i) {
+        BPTreeInner* left = static_cast<BPTreeInner*>(parent->children[i]);
+        BPTreeInner* right = static_cast<BPTreeInner*>(parent->children[i + 1]);
+        RECORD_STATS_ONLY(counters.merges++;)
+
+        left->keys[left->count] = parent->keys[i];
+        for (int j = 0; j < right->count; j++)
+            left->keys[left->count + 1 + j] = right->keys[j];
+        for (int j = 0; j <= right->count; j++)
+            left->children[left->count + 1 + j] = right->children[j];
+        left->count += right->count + 1;
+
+        removeFromInner(parent, i);
+        inners.destroy(right);
+    }
+
+    // Helper function for deletion. Returns true if a record was removed.
+    bool deleteNode(BPTreeNode* node, int ID) {
+        if (node->isLeaf) {
+            BPTreeLeaf* leaf = static_cast<BPTreeLeaf*>(node);
+            int pos = nodeLowerBound(leaf->ids, leaf->count, ID);
+            if (pos == leaf->count || leaf->ids[pos] != ID)
+                return false;
+
+            for (int j = pos + 1; j < leaf->count; j++) {
+                leaf->ids[j - 1] = leaf->ids[j];
+                leaf->records[j - 1] = std::move(leaf->records[j]);
+            }
+            leaf->count--;
+            return true;
+        }
+
+        BPTreeInner* inner = static_cast<BPTreeInner*>(node);
+        int i = nodeUpperBound(inner->keys, inner->count, ID);
+        BPTreeNode* child = inner->children[i];
+        if (!deleteNode(child, ID))
+            return false;
+
+        if (child->isLeaf && child->count < MIN_LEAF_RECORDS)
+            rebalanceLeaf(inner, i);
+        else if (!child->isLeaf && child->count < MIN_INNER_KEYS)
+            rebalanceInner(inner, i);
+        return true;
+    }
+
+public:
+    // Bidirectional cursor over the leaf chain: a leaf and a slot, so it
+    // takes O(1) space. Stepping past either end leaves it invalid; any
+    // insert or remove invalidates it.
+    class Cursor {
+    private:
+        friend class BasicBPTree;
+
+        const BPTreeLeaf* leaf = nullptr;
+        int index = 0;
+
+    public:
+        bool valid() const {
+            return leaf != nullptr;
+        }
+
+        const RecordT& operator*() const {
+            return leaf->records[index];
+        }
+
+        const RecordT* operator->() const {
+            return &leaf->records[index];
+        }
+
+        // Step to the next larger id
+        void next() {
+            if (++index == leaf->count) {
+                leaf = leaf->next;
+                index = 0;
+            }
+        }
+
+        // Step to the next smaller id
+        void prev() {
+            if (--index < 0) {
+                leaf = leaf->prev;
+                index = leaf ? leaf->count - 1 : 0;
+            }
+        }
+    };
+
+    BasicBPTree() : root(nullptr) {}
+
+    BasicBPTree(const BasicBPTree&) = delete;
+    BasicBPTree& operator=(const BasicBPTree&) = delete;
+
+    void insert(const RecordT& rec) {
+        insertIntoRoot(rec);
+    }
+
+    void insert(RecordT&& rec) {
+        insertIntoRoot(std::move(rec));
+    }
+
+    // Construct the record from its constructor arguments and move it in
+    template<typename... Args>
+    void emplace(Args&&... args) {
+        insertIntoRoot(RecordT(std::forward<Args>(args)...));
+    }
+
+    // Insert a copied or moved record, growing a new root if the old one splits
+    template<typename R>
+    void insertIntoRoot(R&& rec) {
+        RECORD_STATS_ONLY(StatsTimer timer(counters.insertLatency);)
+        if (root == nullptr) {
+            BPTreeLeaf* leaf = leaves.create();
+            insertIntoLeaf(leaf, 0, std::forward<R>(rec));
+            root = leaf;
+            return;
+        }
+
+        int upKey;
+        BPTreeNode* right = insertNode(root, std::forward<R>(rec), upKey);
+        if (right != nullptr) {
+            BPTreeInner* newRoot = inners.create();
+            newRoot->keys[0] = upKey;
+            newRoot->children[0] = root;
+            newRoot->children[1] = right;
+            newRoot->count = 1;
+            root = newRoot;
+        }
+    }
+
+    // Build the tree bottom-up from a range of records in O(n) (plus a sort
+    // if the input is not already ordered by id). Leaves are filled as far as
+    // an even split allows and chained in order. Records already in the tree
+    // are kept, and duplicate ids resolve as if inserted one by one.
+    template<typename It>
+    void bulkLoad(It first, It last) {
+        std::vector<RecordT> existing;
+        for (BPTreeLeaf* leaf = firstLeaf(); leaf != nullptr; leaf = leaf->next)
+            existing.insert(existing.end(), leaf->records, leaf->records + leaf->count);
+        std::vector<RecordT> recs = mergeSortedRecords(std::move(existing), sortedUniqueRecords<RecordT>(first, last));
+
+        inners.clear();
+        leaves.clear();
+        root = nullptr;
+        if (recs.empty())
+            return;
+
+        // Leaf level: lows[j] is the smallest id under nodes[j]
+        std::vector<BPTreeNode*> nodes;
+        std::vector<int> lows;
+        long n = (long)recs.size();
+        long k = (n + BPTREE_LEAF_RECORDS - 1) / BPTREE_LEAF_RECORDS;
+        long pos = 0;
+        BPTreeLeaf* prev = nullptr;
+        for (long j = 0; j < k; j++) {
+            long take = n / k + (j < n % k ? 1 : 0);
+            BPTreeLeaf* leaf = leaves.create();
+            for (long t = 0; t < take; t++, pos++) {
+                leaf->ids[t] = recs[pos].id;
+                leaf->records[t] = std::move(recs[pos]);
+            }
+            leaf->count = (int)take;
+            leaf->prev = prev;
+            if (prev)
+                prev->next = leaf;
+            prev = leaf;
+
+            nodes.push_back(leaf);
+            lows.push_back(leaf->ids[0]);
+        }
+
+        // Inner levels: group children evenly, separating them by their lows
+        while (nodes.size() > 1) {
+            long c = (long)nodes.size();
+            long groups = (c + BPTREE_INNER_KEYS) / (BPTREE_INNER_KEYS + 1);
+            std::vector<BPTreeNode*> parents;
+            std::vector<int> parentLows;
+            long child = 0;
+            for (long j = 0; j < groups; j++) {
+                long take = c / groups + (j < c % groups ? 1 : 0);
+                BPTreeInner* inner = inners.create();
+                for (long t = 0; t < take; t++) {
+                    inner->children[t] = nodes[child + t];
+                    if (t > 0)
+                        inner->keys[t - 1] = lows[child + t];
+                }
+                inner->count = (int)take - 1;
+
+                parents.push_back(inner);
+                parentLows.push_back(lows[child]);
+                child += take;
+            }
+            nodes.swap(parents);
+            lows.swap(parentLows);
+        }
+        root = nodes[0];
+    }
+
+    RecordT* search(int ID) {
+        RECORD_STATS_ONLY(StatsTimer timer(counters.searchLatency); uint64_t before = counters.nodesVisited;)
+        BPTreeLeaf* leaf = findLeaf(ID);
+        RECORD_STATS_ONLY(recordSearchVisits(counters, before);)
+        if (leaf == nullptr)
+            return nullptr;
+        int pos = nodeLowerBound(leaf->ids, leaf->count, ID);
+        return pos < leaf->count && leaf->ids[pos] == ID ? &leaf->records[pos] : nullptr;
+    }
+
+    // Look up n ids at once, storing each record (or nullptr) in out. The
+    // descents of a group of keys advance in lockstep. A step either searches
+    // a node's keys (already prefetched) and prefetches the child slot it
+    // picked, or follows that slot and prefetches the child's keys, so the
+    // cache misses of the group overlap.
+    void searchBatch(const int* ids, size_t n, RecordT** out) {
+        BPTreeNode* cursor[SEARCH_BATCH_GROUP];
+        BPTreeNode** pending[SEARCH_BATCH_GROUP];   // Child slot to follow next, if any
+        for (size_t base = 0; base < n; base += SEARCH_BATCH_GROUP) {
+            int group = n - base < (size_t)SEARCH_BATCH_GROUP ? (int)(n - base) : SEARCH_BATCH_GROUP;
+            for (int g = 0; g < group; g++) {
+                cursor[g] = root;
+                pending[g] = nullptr;
+                out[base + g] = nullptr;
+            }
+
+            int active = root ? group : 0;
+            while (active > 0) {
+                active = 0;
+                for (int g = 0; g < group; g++) {
+                    if (pending[g] != nullptr) {
+                        BPTreeNode* child = *pending[g];
+                        pending[g] = nullptr;
+                        cursor[g] = child;
+                        if (child->isLeaf)
+                            prefetchRange(child, sizeof(BPTreeNode) + sizeof(int) * BPTREE_LEAF_RECORDS);
+                        else
+                            prefetchRange(child, sizeof(BPTreeNode) + sizeof(int) * BPTREE_INNER_KEYS);
+                        active++;
+                        continue;
+                    }
+
+                    BPTreeNode* node = cursor[g];
+                    if (node == nullptr)
+                        continue;
+
+                    int ID = ids[base + g];
+                    if (node->isLeaf) {
+                        BPTreeLeaf* leaf = static_cast<BPTreeLeaf*>(node);
+                        int pos = nodeLowerBound(leaf->ids, leaf->count, ID);
+                        if (pos < leaf->count && leaf->ids[pos] == ID)
+                            out[base + g] = &leaf->records[pos];
+                        cursor[g] = nullptr;
+                        continue;
+                    }
+
+                    BPTreeInner* inner = static_cast<BPTreeInner*>(node);
+                    pending[g] = &inner->children[nodeUpperBound(inner->keys, inner->count, ID)];
+                    __builtin_prefetch(pending[g]);
+                    active++;
+                }
+            }
+        }
+    }
+
+    void remove(int ID) {
+        RECORD_STATS_ONLY(StatsTimer timer(counters.removeLatency);)
+        if (root == nullptr || !deleteNode(root, ID))
+            return;
+
+        // Shrink the tree when the root runs out of keys
+        if (root->count == 0) {
+            BPTreeNode* tmp = root;
+            if (root->isLeaf) {
+                root = nullptr;
+                leaves.destroy(static_cast<BPTreeLeaf*>(tmp));
+            } else {
+                root = static_cast<BPTreeInner*>(tmp)->children[0];
+                inners.destroy(static_cast<BPTreeInner*>(tmp));
+            }
+        }
+    }
+
+    ArenaStats arenaStats() const {
+        return inners.stats() + leaves.stats();
+    }
+
+    // Snapshot of the instrumentation counters; empty unless built with -DRECORD_STATS
+    IndexStats stats() const {
+#ifdef RECORD_STATS
+        return counters;
+#else
+        return IndexStats();
+#endif
+    }
+
+    void resetStats() {
+        RECORD_STATS_ONLY(counters = IndexStats();)
+    }
+
+    // Cursor at the smallest id
+    Cursor first() const {
+        Cursor c;
+        c.leaf = firstLeaf();
+        return c;
+    }
+
+    // Cursor at the largest id
+    Cursor last() const {
+        Cursor c;
+        const BPTreeNode* node = root;
+        while (node != nullptr && !node->isLeaf)
+            node = static_cast<const BPTreeInner*>(node)->children[node->count];
+        c.leaf = static_cast<const BPTreeLeaf*>(node);
+        c.index = c.leaf ? c.leaf->count - 1 : 0;
+        return c;
+    }
+
+    // Cursor at the first record whose id is >= ID
+    Cursor lowerBound(int ID) const {
+        Cursor c;
+        const BPTreeNode* node = root;
+        while (node != nullptr && !node->isLeaf) {
+            const BPTreeInner* inner = static_cast<const BPTreeInner*>(node);
+            node = inner->children[nodeUpperBound(inner->keys, inner->count, ID)];
+        }
+        c.leaf = static_cast<const BPTreeLeaf*>(node);
+        if (c.leaf) {
+            c.index = nodeLowerBound(c.leaf->ids, c.leaf->count, ID);
+            if (c.index == c.leaf->count) {
+                c.leaf = c.leaf->next;
+                c.index = 0;
+            }
+        }
+        return c;
+    }
+
+    // Call fn(const RecordT&) on every record with lo <= id <= hi, in id
+    // order and without copying. Returns the number of records visited.
+    // One descent finds the first leaf; after that the scan sweeps leaf
+    // arrays along the chain.
+    template<typename Fn>
+    size_t rangeScan(int lo, int hi, Fn&& fn) const {
+        size_t count = 0;
+        if (lo > hi)
+            return 0;
+        Cursor c = lowerBound(lo);
+        for (const BPTreeLeaf* leaf = c.leaf; leaf != nullptr; leaf = leaf->next) {
+            int i = leaf == c.leaf ? c.index : 0;
+            int end = nodeUpperBound(leaf->ids, leaf->count, hi);
+            if (end > i)
+                count += end - i;
+            for (; i < end; i++)
+                fn(leaf->records[i]);
+            if (end < leaf->count)
+                break;
+        }
+        return count;
+    }
+
+    // Print all records in order by walking the leaf chain
+    void traverse() {
+        for (BPTreeLeaf* leaf = firstLeaf(); leaf != nullptr; leaf = leaf->next) {
+            for (int j = 0; j < leaf->count; j++)
+                std::cout << leaf->records[j] << std::endl;
+        }
+        std::cout << std::endl;
+    }
+};
+
+typedef BasicBPTreeLeaf<Record> BPTreeLeaf;
+typedef BasicBPTree<Record> BPTree;
+
+#endif
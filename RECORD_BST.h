@@ -2,55 +2,92 @@
 #define RECORD_BST_H
 
 #include <iostream>
+#include <vector>
 #include "RECORD.h"
+#include "BULK_LOAD.h"
+#include "INDEX_POLICY.h"
+#include "RECORD_FROZEN.h"
+#include "NODE_ARENA.h"
+#include "NODE_SEARCH.h"
+#include "RECORD_STATS.h"
 
 // BSTNode class representing a node in the Binary Search Tree
-class BSTNode {
+template<typename RecordT>
+class BasicBSTNode {
 public:
-    Record rec;
-    BSTNode* left;
-    BSTNode* right;
+    RecordT rec;
+    BasicBSTNode* left;
+    BasicBSTNode* right;
 
-    BSTNode(Record _rec = Record(), BSTNode* _left = nullptr, BSTNode* _right = nullptr)
-        : rec(_rec), left(_left), right(_right) {}
+    BasicBSTNode(RecordT _rec = RecordT(), BasicBSTNode* _left = nullptr, BasicBSTNode* _right = nullptr)
+        : rec(std::move(_rec)), left(_left), right(_right) {}
 };
 
-// BST class encapsulating the Binary Search Tree
-class BST {
+// BST class encapsulating the Binary Search Tree, storing Record,
+// CompactRecord or any record type KeyOf can extract a key from
+template<typename RecordT, typename KeyOf = RecordId, typename Compare = std::less<IndexKey<RecordT, KeyOf>>>
+class BasicBST {
+public:
+    typedef RecordT RecordType;
+    typedef IndexKey<RecordT, KeyOf> KeyType;
+
 private:
-    BSTNode* root;
+    typedef BasicBSTNode<RecordT> BSTNode;
 
-    // Helper function for insertion
-    BSTNode* insertNode(BSTNode* tree, Record rec) {
-        if (tree == nullptr)
-            return new BSTNode(rec);
+    BSTNode* root;
+    NodeArena<BSTNode> arena;   // Owns every node; freed chunk by chunk with the tree
+#ifdef RECORD_STATS
+    mutable IndexStats counters;
+#endif
 
-        if (tree->rec.id == rec.id)
-            return tree;
+    // Helper functions to apply the key policies
+    static decltype(auto) keyOf(const RecordT& rec) {
+        return KeyOf()(rec);
+    }
 
-        if (rec.id < tree->rec.id)
-            tree->left = insertNode(tree->left, rec);
-        else
-            tree->right = insertNode(tree->right, rec);
+    static bool less(const KeyType& a, const KeyType& b) {
+        return Compare()(a, b);
+    }
 
-        return tree;
+    // Helper function for insertion. Walks down through the child links so
+    // degenerate (sorted-input) trees cannot exhaust the call stack. The
+    // record is only copied or moved once, into the new node.
+    template<typename R>
+    void insertNode(R&& rec) {
+        RECORD_STATS_ONLY(StatsTimer timer(counters.insertLatency);)
+        const KeyType& key = keyOf(rec);
+        BSTNode** link = &root;
+        while (*link != nullptr) {
+            if (less(key, keyOf((*link)->rec)))
+                link = &(*link)->left;
+            else if (less(keyOf((*link)->rec), key))
+                link = &(*link)->right;
+            else
+                return;
+        }
+        *link = arena.create(std::forward<R>(rec));
     }
 
     // Helper function for finding a node
-    BSTNode* findNode(BSTNode* tree, int ID) {
-        if (tree == nullptr || tree->rec.id == ID)
-            return tree;
-
-        if (ID < tree->rec.id)
-            return findNode(tree->left, ID);
-        else
-            return findNode(tree->right, ID);
+    BSTNode* findNode(BSTNode* tree, const KeyType& key) {
+        RECORD_STATS_ONLY(StatsTimer timer(counters.searchLatency); uint64_t before = counters.nodesVisited;)
+        while (tree != nullptr) {
+            RECORD_STATS_ONLY(counters.nodesVisited++;)
+            if (less(key, keyOf(tree->rec)))
+                tree = tree->left;
+            else if (less(keyOf(tree->rec), key))
+                tree = tree->right;
+            else
+                break;
+        }
+        RECORD_STATS_ONLY(recordSearchVisits(counters, before);)
+        return tree;
     }
 
     // Helper functions for traversal
     void preOrderTraversal(BSTNode* tree) {
         if (tree != nullptr) {
-            std::cout << "ID: " << tree->rec.id << ", Name: " << tree->rec.name << ", Age: " << tree->rec.age << std::endl;
+            std::cout << tree->rec << std::endl;
             preOrderTraversal(tree->left);
             preOrderTraversal(tree->right);
         }
@@ -59,7 +96,7 @@ private:
     void inOrderTraversal(BSTNode* tree) {
         if (tree != nullptr) {
             inOrderTraversal(tree->left);
-            std::cout << "ID: " << tree->rec.id << ", Name: " << tree->rec.name << ", Age: " << tree->rec.age << std::endl;
+            std::cout << tree->rec << std::endl;
             inOrderTraversal(tree->right);
         }
     }
@@ -68,67 +105,87 @@ private:
         if (tree != nullptr) {
             postOrderTraversal(tree->left);
             postOrderTraversal(tree->right);
-            std::cout << "ID: " << tree->rec.id << ", Name: " << tree->rec.name << ", Age: " << tree->rec.age << std::endl;
+            std::cout << tree->rec << std::endl;
         }
     }
 
     void inOrderDescendingTraversal(BSTNode* tree) {
         if (tree != nullptr) {
             inOrderDescendingTraversal(tree->right);
-            std::cout << "ID: " << tree->rec.id << ", Name: " << tree->rec.name << ", Age: " << tree->rec.age << std::endl;
+            std::cout << tree->rec << std::endl;
             inOrderDescendingTraversal(tree->left);
         }
     }
 
-    // Helper function to find the minimum value node
-    int getMinValue(BSTNode* tree) {
-        if (tree->left == nullptr)
-            return tree->rec.id;
-        return getMinValue(tree->left);
-    }
-
     // Helper function for node deletion
-    BSTNode* deleteNode(BSTNode* tree, int ID) {
+    void deleteNode(const KeyType& key) {
+        RECORD_STATS_ONLY(StatsTimer timer(counters.removeLatency);)
+        BSTNode** link = &root;
+        while (*link != nullptr) {
+            if (less(key, keyOf((*link)->rec)))
+                link = &(*link)->left;
+            else if (less(keyOf((*link)->rec), key))
+                link = &(*link)->right;
+            else
+                break;
+        }
+
+        BSTNode* tree = *link;
         if (tree == nullptr)
-            return tree;
-
-        if (ID < tree->rec.id) {
-            tree->left = deleteNode(tree->left, ID);
-        } else if (ID > tree->rec.id) {
-            tree->right = deleteNode(tree->right, ID);
-        } else {
-            if (tree->left == nullptr && tree->right == nullptr) {
-                delete tree;
-                return nullptr;
-            }
+            return;
 
-            if (tree->left == nullptr) {
-                BSTNode* temp = tree->right;
-                delete tree;
-                return temp;
-            }
+        if (tree->left == nullptr || tree->right == nullptr) {
+            *link = tree->left ? tree->left : tree->right;
+            arena.destroy(tree);
+            return;
+        }
 
-            if (tree->right == nullptr) {
-                BSTNode* temp = tree->left;
-                delete tree;
-                return temp;
-            }
+        // Two children: pull up the minimum of the right subtree
+        BSTNode** minLink = &tree->right;
+        while ((*minLink)->left != nullptr)
+            minLink = &(*minLink)->left;
+
+        BSTNode* minNode = *minLink;
+        tree->rec = std::move(minNode->rec);
+        *minLink = minNode->right;
+        arena.destroy(minNode);
+    }
 
-            int minValue = getMinValue(tree->right);
-            BSTNode* minNode = findNode(tree, minValue);
-            tree->rec = minNode->rec;
-            tree->right = deleteNode(tree->right, minValue);
+    // Helper function to copy out all records in order without recursion
+    std::vector<RecordT> collectRecords() const {
+        std::vector<RecordT> recs;
+        std::vector<BSTNode*> stack;
+        BSTNode* tree = root;
+        while (tree != nullptr || !stack.empty()) {
+            while (tree != nullptr) {
+                stack.push_back(tree);
+                tree = tree->left;
+            }
+            tree = stack.back();
+            stack.pop_back();
+            recs.push_back(tree->rec);
+            tree = tree->right;
         }
+        return recs;
+    }
 
+    // Helper function to build a perfectly balanced tree from sorted records
+    BSTNode* buildBalanced(std::vector<RecordT>& recs, long lo, long hi) {
+        if (lo > hi)
+            return nullptr;
+        long mid = lo + (hi - lo) / 2;
+        BSTNode* tree = arena.create(std::move(recs[mid]));
+        tree->left = buildBalanced(recs, lo, mid - 1);
+        tree->right = buildBalanced(recs, mid + 1, hi);
         return tree;
     }
 
     // Helper functions to find in-order predecessor and successor
-    int inOrderPredecessor(BSTNode* tree, int ID) {
-        int predecessor = -1;
+    KeyType inOrderPredecessor(BSTNode* tree, const KeyType& key, KeyType none) {
+        KeyType predecessor = none;
         while (tree != nullptr) {
-            if (tree->rec.id < ID) {
-                predecessor = tree->rec.id;
+            if (less(keyOf(tree->rec), key)) {
+                predecessor = keyOf(tree->rec);
                 tree = tree->right;
             } else {
                 tree = tree->left;
@@ -137,11 +194,11 @@ private:
         return predecessor;
     }
 
-    int inOrderSuccessor(BSTNode* tree, int ID) {
-        int successor = -1;
+    KeyType inOrderSuccessor(BSTNode* tree, const KeyType& key, KeyType none) {
+        KeyType successor = none;
         while (tree != nullptr) {
-            if (tree->rec.id > ID) {
-                successor = tree->rec.id;
+            if (less(key, keyOf(tree->rec))) {
+                successor = keyOf(tree->rec);
                 tree = tree->left;
             } else {
                 tree = tree->right;
@@ -151,19 +208,144 @@ private:
     }
 
 public:
-    BST() : root(nullptr) {}
+    // Bidirectional in-order cursor. It keeps the path from the root, so it
+    // takes O(height) space and no parent links are needed. Stepping past
+    // either end leaves it invalid; any insert or remove invalidates it.
+    class Cursor {
+    private:
+        friend class BasicBST;
+
+        std::vector<const BSTNode*> path;
+
+        void pushLeftSpine(const BSTNode* tree) {
+            for (; tree != nullptr; tree = tree->left)
+                path.push_back(tree);
+        }
+
+        void pushRightSpine(const BSTNode* tree) {
+            for (; tree != nullptr; tree = tree->right)
+                path.push_back(tree);
+        }
+
+    public:
+        bool valid() const {
+            return !path.empty();
+        }
+
+        const RecordT& operator*() const {
+            return path.back()->rec;
+        }
+
+        const RecordT* operator->() const {
+            return &path.back()->rec;
+        }
+
+        // Step to the next larger key
+        void next() {
+            const BSTNode* tree = path.back();
+            if (tree->right != nullptr) {
+                pushLeftSpine(tree->right);
+                return;
+            }
+            path.pop_back();
+            while (!path.empty() && path.back()->right == tree) {
+                tree = path.back();
+                path.pop_back();
+            }
+        }
+
+        // Step to the next smaller key
+        void prev() {
+            const BSTNode* tree = path.back();
+            if (tree->left != nullptr) {
+                pushRightSpine(tree->left);
+                return;
+            }
+            path.pop_back();
+            while (!path.empty() && path.back()->left == tree) {
+                tree = path.back();
+                path.pop_back();
+            }
+        }
+    };
+
+    BasicBST() : root(nullptr) {}
+
+    BasicBST(const BasicBST&) = delete;
+    BasicBST& operator=(const BasicBST&) = delete;
+
+    void insert(const RecordT& rec) {
+        insertNode(rec);
+    }
+
+    void insert(RecordT&& rec) {
+        insertNode(std::move(rec));
+    }
 
-    void insert(Record rec) {
-        root = insertNode(root, rec);
+    // Construct the record from its constructor arguments and move it in
+    template<typename... Args>
+    void emplace(Args&&... args) {
+        insertNode(RecordT(std::forward<Args>(args)...));
     }
 
-    Record* search(int ID) {
-        BSTNode* node = findNode(root, ID);
+    // Build the tree bottom-up from a range of records in O(n) (plus a sort
+    // if the input is not already ordered by key). Records already in the
+    // tree are kept, and duplicate keys resolve as if inserted one by one.
+    template<typename It>
+    void bulkLoad(It first, It last) {
+        std::vector<RecordT> recs = mergeSortedRecords<KeyOf, Compare>(collectRecords(),
+                                                                       sortedUniqueRecords<RecordT, KeyOf, Compare>(first, last));
+        arena.clear();
+        root = buildBalanced(recs, 0, (long)recs.size() - 1);
+    }
+
+    RecordT* search(const KeyType& key) {
+        BSTNode* node = findNode(root, key);
         return node ? &node->rec : nullptr;
     }
 
-    void remove(int ID) {
-        root = deleteNode(root, ID);
+    // Look up n keys at once, storing each record (or nullptr) in out. The
+    // descents of a group of keys advance in lockstep and every step
+    // prefetches the next node, so the cache misses of the group overlap
+    // instead of being paid one after another.
+    void searchBatch(const KeyType* keys, size_t n, RecordT** out) {
+        BSTNode* cursor[SEARCH_BATCH_GROUP];
+        for (size_t base = 0; base < n; base += SEARCH_BATCH_GROUP) {
+            int group = n - base < (size_t)SEARCH_BATCH_GROUP ? (int)(n - base) : SEARCH_BATCH_GROUP;
+            for (int g = 0; g < group; g++) {
+                cursor[g] = root;
+                out[base + g] = nullptr;
+            }
+
+            int active = group;
+            while (active > 0) {
+                active = 0;
+                for (int g = 0; g < group; g++) {
+                    BSTNode* node = cursor[g];
+                    if (node == nullptr)
+                        continue;
+
+                    const KeyType& key = keys[base + g];
+                    bool goLeft = less(key, keyOf(node->rec));
+                    if (!goLeft && !less(keyOf(node->rec), key)) {
+                        out[base + g] = &node->rec;
+                        cursor[g] = nullptr;
+                        continue;
+                    }
+
+                    node = goLeft ? node->left : node->right;
+                    cursor[g] = node;
+                    if (node != nullptr) {
+                        __builtin_prefetch(node);
+                        active++;
+                    }
+                }
+            }
+        }
+    }
+
+    void remove(const KeyType& key) {
+        deleteNode(key);
     }
 
     void preOrder() {
@@ -182,13 +364,84 @@ public:
         inOrderDescendingTraversal(root);
     }
 
-    int getInOrderPredecessor(int ID) {
-        return inOrderPredecessor(root, ID);
+    // Cursor at the smallest key
+    Cursor first() const {
+        Cursor c;
+        c.pushLeftSpine(root);
+        return c;
     }
 
-    int getInOrderSuccessor(int ID) {
-        return inOrderSuccessor(root, ID);
+    // Cursor at the largest key
+    Cursor last() const {
+        Cursor c;
+        c.pushRightSpine(root);
+        return c;
+    }
+
+    // Cursor at the first record whose key is not less than key
+    Cursor lowerBound(const KeyType& key) const {
+        Cursor c;
+        const BSTNode* tree = root;
+        while (tree != nullptr) {
+            c.path.push_back(tree);
+            if (less(key, keyOf(tree->rec)))
+                tree = tree->left;
+            else if (less(keyOf(tree->rec), key))
+                tree = tree->right;
+            else
+                return c;
+        }
+        // The search ended below the last node on the path; if that node is
+        // smaller than key, its successor is the answer
+        if (c.valid() && less(keyOf(*c), key))
+            c.next();
+        return c;
+    }
+
+    // Call fn(const RecordT&) on every record with lo <= key <= hi, in key
+    // order and without copying. Returns the number of records visited.
+    template<typename Fn>
+    size_t rangeScan(const KeyType& lo, const KeyType& hi, Fn&& fn) const {
+        size_t count = 0;
+        for (Cursor c = lowerBound(lo); c.valid() && !less(hi, keyOf(*c)); c.next(), count++)
+            fn(*c);
+        return count;
+    }
+
+    // Immutable, pointer-free copy of the tree for read-only phases
+    BasicFrozenIndex<RecordT, KeyOf, Compare> freeze() const {
+        return BasicFrozenIndex<RecordT, KeyOf, Compare>(collectRecords());
+    }
+
+    // Neighbouring keys of key, or none if there is no such record. none
+    // defaults to -1, the sentinel for id keys.
+    KeyType getInOrderPredecessor(const KeyType& key, KeyType none = KeyType(-1)) {
+        return inOrderPredecessor(root, key, none);
+    }
+
+    KeyType getInOrderSuccessor(const KeyType& key, KeyType none = KeyType(-1)) {
+        return inOrderSuccessor(root, key, none);
+    }
+
+    ArenaStats arenaStats() const {
+        return arena.stats();
+    }
+
+    // Snapshot of the instrumentation counters; empty unless built with -DRECORD_STATS
+    IndexStats stats() const {
+#ifdef RECORD_STATS
+        return counters;
+#else
+        return IndexStats();
+#endif
+    }
+
+    void resetStats() {
+        RECORD_STATS_ONLY(counters = IndexStats();)
     }
 };
 
+typedef BasicBSTNode<Record> BSTNode;
+typedef BasicBST<Record> BST;
+
 #endif
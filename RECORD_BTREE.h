@@ -1,286 +1,990 @@
 #ifndef RECORD_BTREE_h
 #define RECORD_BTREE_h
 
+#include <algorithm>
+#include <cstdint>
 #include <iostream>
 #include <vector>
 #include <string>
+#include <iterator>
+#include <utility>
 #include "RECORD.h"
-
-// A BTree Node structure
-class BTreeNode {
+#include "INDEX_POLICY.h"
+#include "RECORD_FROZEN.h"
+#include "INLINE_VECTOR.h"
+#include "NODE_SEARCH.h"
+#include "NODE_ARENA.h"
+#include "BULK_LOAD.h"
+#include "RECORD_STATS.h"
+
+// A BTree Node structure. With Fanout == 0 the arrays are std::vectors
+// sized by the tree's run-time degree; otherwise they are inline arrays of
+// exactly the compile-time capacity, so a node is a single allocation. A node
+// holds up to Fanout children, and briefly Fanout records before a split.
+//
+// A record can be dead: removed in lazy mode but still in place, so it keeps
+// routing searches in an inner node. Dead records are skipped by every lookup
+// and scan and are not counted in childCounts.
+template<typename RecordT, int Fanout = 0, typename KeyOf = RecordId, typename Compare = std::less<IndexKey<RecordT, KeyOf>>>
+class BasicBTreeNode {
 public:
-    std::vector<Record> records;     // List of records (keys with additional data)
-    std::vector<BTreeNode*> children; // Child pointers
+    typedef IndexKey<RecordT, KeyOf> KeyType;
+
+    template<typename T, int N>
+    using NodeArray = std::conditional_t<Fanout == 0, std::vector<T>, InlineVector<T, N>>;
+
+    NodeArray<RecordT, Fanout> records;     // List of records (keys with additional data)
+    NodeArray<KeyType, Fanout> keys;        // Packed copy of each record's key for the node search kernel
+    NodeArray<BasicBTreeNode*, Fanout + 1> children; // Child pointers
+    NodeArray<long, Fanout + 1> childCounts;    // childCounts[i] is the number of live records under children[i]
+    NodeArray<uint8_t, Fanout> dead;        // dead[i] is set once records[i] has been removed lazily
+    int deadCount = 0;           // Number of dead records in the node
     bool isLeaf;                 // Is true if the node is a leaf
     int maxKeys;                 // Maximum number of keys in the node
+    NodeArena<BasicBTreeNode>* arena; // Arena of the owning tree, used for splits and merges
+#ifdef RECORD_STATS
+    IndexStats* stats = nullptr;      // Counters of the owning tree
+#endif
 
     // Constructor
-    BTreeNode(int maxKeys, bool isLeaf) {
+    BasicBTreeNode(int maxKeys, bool isLeaf, NodeArena<BasicBTreeNode>* arena) {
         this->maxKeys = maxKeys;
         this->isLeaf = isLeaf;
+        this->arena = arena;
+    }
+
+    // Minimum number of keys in any node but the root
+    int minKeys() const {
+        return maxKeys / 2;
+    }
+
+    int size() const {
+        return (int)records.size();
+    }
+
+    // Position of the first record whose key is not less than key
+    int findIndex(const KeyType& key) const {
+        return keyLowerBound<Compare>(keys.data(), size(), key);
+    }
+
+    // Whether the record at a findIndex() position holds key itself
+    bool matches(int i, const KeyType& key) const {
+        return i < size() && !Compare()(key, keys[i]);
+    }
+
+    // Number of live records among the first i of the node
+    int liveBefore(int i) const {
+        if (deadCount == 0)
+            return i;
+        return i - (int)std::count(dead.begin(), dead.begin() + i, 1);
+    }
+
+    // Position of the live record k (0-based) in the node
+    int liveIndex(long k) const {
+        if (deadCount == 0)
+            return (int)k;
+        for (int i = 0;; i++) {
+            if (dead[i])
+                continue;
+            if (k == 0)
+                return i;
+            k--;
+        }
+    }
+
+    // Number of live records in the subtree rooted with this node
+    long subtreeCount() const {
+        long count = size() - deadCount;
+        for (long c : childCounts)
+            count += c;
+        return count;
     }
 
     // Traverse the tree and print records
     void traverse() {
-        for (int i = 0; i < records.size(); i++) {
+        for (int i = 0; i < size(); i++) {
             if (!isLeaf)
                 children[i]->traverse();
-            std::cout << "ID: " << records[i].id << ", Name: " << records[i].name << ", Age: " << records[i].age << std::endl;
+            if (!dead[i])
+                std::cout << records[i] << std::endl;
         }
         if (!isLeaf)
-            children[records.size()]->traverse();
+            children[size()]->traverse();
     }
 
-    // Search for a record by ID in the subtree rooted with this node
-    Record* search(int id) {
-        int i = 0;
-        while (i < records.size() && id > records[i].id)
-            i++;
+    // Append the records of the subtree in order
+    void collectRecords(std::vector<RecordT>& out) {
+        for (int i = 0; i < size(); i++) {
+            if (!isLeaf)
+                children[i]->collectRecords(out);
+            if (!dead[i])
+                out.push_back(records[i]);
+        }
+        if (!isLeaf)
+            children[size()]->collectRecords(out);
+    }
+
+    // Search for a record by key in the subtree rooted with this node
+    RecordT* search(const KeyType& key) {
+        RECORD_STATS_ONLY(stats->nodesVisited++;)
+        int i = findIndex(key);
 
-        if (i < records.size() && records[i].id == id)
-            return &records[i];
+        if (matches(i, key))
+            return dead[i] ? nullptr : &records[i];
 
-        return isLeaf ? nullptr : children[i]->search(id);
+        return isLeaf ? nullptr : children[i]->search(key);
     }
 
-    // Remove a record by ID
-    void remove(int id, int degree);
+    // Keep records, keys and dead flags in step. Records are taken by value
+    // and moved into place, so callers pass rvalues to avoid copying the name.
+    void insertRecord(int index, RecordT record, bool isDead = false);
+    void eraseRecord(int index);
+    void setRecord(int index, RecordT record, bool isDead = false);
+    // Recount the dead flags after whole ranges moved between nodes
+    void countDead();
+
+    // Remove a record by key, returns false if it was not found
+    bool remove(const KeyType& key);
     void removeFromLeaf(int index);
-    void removeFromNonLeaf(int index, int degree);
-    Record getPredecessor(int index);
-    Record getSuccessor(int index);
+    void removeFromNonLeaf(int index);
+    RecordT& getPredecessor(int index);
+    RecordT& getSuccessor(int index);
     void merge(int index);
-    void fill(int index, int degree);
+    void fill(int index);
     void borrowFromPrev(int index);
     void borrowFromNext(int index);
 
-    // Insert a record in a non-full node
-    void insertNonFull(Record record);
-    // Split a child
-    void splitChild(int i, BTreeNode* child);
+    // Mark the record with key dead, returns false if it was not found.
+    // Nothing moves, only childCounts on the path are updated.
+    bool removeLazy(const KeyType& key);
+    // Drop the dead records of a leaf
+    void purgeDead(long& tombstones);
+
+    // Insert a record into the subtree, returns false on a duplicate key.
+    // Inserting over a dead record revives it in place. The node may be
+    // left with maxKeys + 1 records for the parent to split.
+    template<typename R>
+    bool insert(R&& record, long& tombstones);
+    // Split an overfull child
+    void splitChild(int i, BasicBTreeNode* child);
 };
 
-class BTree {
+// BTree class, storing Record, CompactRecord or any record type KeyOf can
+// extract a key from. Fanout is the compile-time maximum number of children
+// per node, or 0 to take the degree at run time.
+template<typename RecordT, int Fanout = 0, typename KeyOf = RecordId, typename Compare = std::less<IndexKey<RecordT, KeyOf>>>
+class BasicBTree {
 public:
+    typedef RecordT RecordType;
+    typedef IndexKey<RecordT, KeyOf> KeyType;
+    typedef BasicBTreeNode<RecordT, Fanout, KeyOf, Compare> BTreeNode;
+
+    static_assert(Fanout == 0 || Fanout >= 3, "a BTree node needs at least 3 children");
+
+    // Bidirectional in-order cursor. It keeps one (node, index) frame per
+    // level, so it takes O(height) space. Stepping past either end leaves it
+    // invalid; any insert or remove invalidates it.
+    class Cursor {
+    private:
+        friend class BasicBTree;
+
+        struct Frame {
+            const BTreeNode* node;
+            int index;
+        };
+        // The top frame indexes the current record; every frame below it
+        // holds the index of the child the path descends into
+        std::vector<Frame> path;
+
+        void descendFirst(const BTreeNode* node) {
+            while (true) {
+                path.push_back({node, 0});
+                if (node->isLeaf)
+                    return;
+                node = node->children[0];
+            }
+        }
+
+        void descendLast(const BTreeNode* node) {
+            while (!node->isLeaf) {
+                path.push_back({node, node->size()});
+                node = node->children[node->size()];
+            }
+            path.push_back({node, node->size() - 1});
+        }
+
+        // Pop finished levels after leaving a subtree to the right; the child
+        // index left on top is then also the index of the next record
+        void ascendRight() {
+            path.pop_back();
+            while (!path.empty() && path.back().index >= path.back().node->size())
+                path.pop_back();
+        }
+
+        void stepNext() {
+            Frame& top = path.back();
+            if (!top.node->isLeaf) {
+                top.index++;
+                descendFirst(top.node->children[top.index]);
+            } else if (++top.index == top.node->size()) {
+                ascendRight();
+            }
+        }
+
+        void stepPrev() {
+            Frame& top = path.back();
+            if (!top.node->isLeaf) {
+                descendLast(top.node->children[top.index]);
+                return;
+            }
+            if (--top.index >= 0)
+                return;
+            path.pop_back();
+            while (!path.empty() && path.back().index == 0)
+                path.pop_back();
+            if (!path.empty())
+                path.back().index--;
+        }
+
+        // Move off dead records, in the direction of the last step
+        void skipDeadForward() {
+            while (valid() && path.back().node->dead[path.back().index])
+                stepNext();
+        }
+
+        void skipDeadBackward() {
+            while (valid() && path.back().node->dead[path.back().index])
+                stepPrev();
+        }
+
+    public:
+        bool valid() const {
+            return !path.empty();
+        }
+
+        const RecordT& operator*() const {
+            return path.back().node->records[path.back().index];
+        }
+
+        const RecordT* operator->() const {
+            return &path.back().node->records[path.back().index];
+        }
+
+        // Step to the next larger key
+        void next() {
+            stepNext();
+            skipDeadForward();
+        }
+
+        // Step to the next smaller key
+        void prev() {
+            stepPrev();
+            skipDeadBackward();
+        }
+    };
+
     BTreeNode* root;
     int maxKeys;
+    bool lazy;                    // remove() marks records dead instead of restructuring
+    long tombstones;              // Dead records still stored in the tree
+    NodeArena<BTreeNode> arena;   // Owns every node; freed chunk by chunk with the tree
+#ifdef RECORD_STATS
+    mutable IndexStats counters;
+#endif
 
-    BTree(int degree) {
+    // degree is the maximum number of children per node and must be at least 3
+    explicit BasicBTree(int degree) {
+        static_assert(Fanout == 0, "this BTree has a compile-time fan-out; use the default constructor");
         root = nullptr;
         maxKeys = degree - 1;
+        lazy = false;
+        tombstones = 0;
     }
 
+    BasicBTree() {
+        static_assert(Fanout != 0, "a BTree without a compile-time fan-out needs a degree");
+        root = nullptr;
+        maxKeys = Fanout - 1;
+        lazy = false;
+        tombstones = 0;
+    }
+
+    BasicBTree(const BasicBTree&) = delete;
+    BasicBTree& operator=(const BasicBTree&) = delete;
+
     void traverse() {
         if (root)
             root->traverse();
         std::cout << std::endl;
     }
 
-    Record* search(int id) {
-        return root ? root->search(id) : nullptr;
+    RecordT* search(const KeyType& key) {
+        RECORD_STATS_ONLY(StatsTimer timer(counters.searchLatency); uint64_t before = counters.nodesVisited;)
+        RecordT* found = root ? root->search(key) : nullptr;
+        RECORD_STATS_ONLY(recordSearchVisits(counters, before);)
+        return found;
     }
 
-    void insert(Record rec);
-    void remove(int id) {
+    // Build a packed tree bottom-up from a range of records in O(n) (plus a
+    // sort if the input is not already ordered by key). Records already in
+    // the tree are kept, and duplicate keys resolve as if inserted one by one.
+    // Dead records are dropped on the way.
+    template<typename It>
+    void bulkLoad(It first, It last) {
+        std::vector<RecordT> existing;
+        if (root)
+            root->collectRecords(existing);
+        std::vector<RecordT> level = mergeSortedRecords<KeyOf, Compare>(std::move(existing),
+                                                                              sortedUniqueRecords<RecordT, KeyOf, Compare>(first, last));
+
+        arena.clear();
+        root = nullptr;
+        tombstones = 0;
+        if (level.empty())
+            return;
+
+        // Each pass packs one level: m keys become k nodes of nearly maxKeys
+        // keys, and the k - 1 keys between them move up as the next level.
+        std::vector<BTreeNode*> below;
+        std::vector<long> belowCounts;     // Records under each node of the level below
+        while (true) {
+            long m = (long)level.size();
+            long k = (m + 1 + maxKeys) / (maxKeys + 1);   // ceil((m + 1) / (maxKeys + 1))
+            long keys = m - (k - 1);
+
+            std::vector<BTreeNode*> nodes;
+            std::vector<long> nodeCounts;
+            std::vector<RecordT> separators;
+            long pos = 0, child = 0;
+            for (long j = 0; j < k; j++) {
+                long take = keys / k + (j < keys % k ? 1 : 0);
+                BTreeNode* node = arena.create(maxKeys, below.empty(), &arena);
+                RECORD_STATS_ONLY(node->stats = &counters;)
+                node->records.reserve(maxKeys + 1);
+                node->keys.reserve(maxKeys + 1);
+                for (long t = 0; t < take; t++) {
+                    node->keys.push_back(KeyOf()(level[pos]));
+                    node->records.push_back(std::move(level[pos++]));
+                }
+                node->dead.resize(take);
+                if (!below.empty()) {
+                    node->children.assign(below.begin() + child, below.begin() + child + take + 1);
+                    node->childCounts.assign(belowCounts.begin() + child, belowCounts.begin() + child + take + 1);
+                }
+                child += take + 1;
+
+                nodes.push_back(node);
+                nodeCounts.push_back(node->subtreeCount());
+                if (j + 1 < k)
+                    separators.push_back(std::move(level[pos++]));
+            }
+
+            if (k == 1) {
+                root = nodes[0];
+                return;
+            }
+            below.swap(nodes);
+            belowCounts.swap(nodeCounts);
+            level.swap(separators);
+        }
+    }
+
+    // Look up n keys at once, storing each record (or nullptr) in out. The
+    // descents of a group of keys advance in lockstep: one round prefetches a
+    // node's id and child arrays, the next searches them and prefetches the
+    // child, so the cache misses of the group overlap.
+    void searchBatch(const KeyType* keys, size_t n, RecordT** out) {
+        BTreeNode* cursor[SEARCH_BATCH_GROUP];
+        bool arraysRequested[SEARCH_BATCH_GROUP];
+        for (size_t base = 0; base < n; base += SEARCH_BATCH_GROUP) {
+            int group = n - base < (size_t)SEARCH_BATCH_GROUP ? (int)(n - base) : SEARCH_BATCH_GROUP;
+            for (int g = 0; g < group; g++) {
+                cursor[g] = root;
+                arraysRequested[g] = false;
+                out[base + g] = nullptr;
+            }
+
+            int active = root ? group : 0;
+            while (active > 0) {
+                active = 0;
+                for (int g = 0; g < group; g++) {
+                    BTreeNode* node = cursor[g];
+                    if (node == nullptr)
+                        continue;
+                    active++;
+
+                    if (!arraysRequested[g]) {
+                        prefetchRange(node->keys.data(), node->keys.size() * sizeof(KeyType));
+                        if (!node->isLeaf)
+                            prefetchRange(node->children.data(), node->children.size() * sizeof(BTreeNode*));
+                        arraysRequested[g] = true;
+                        continue;
+                    }
+
+                    const KeyType& key = keys[base + g];
+                    int i = node->findIndex(key);
+                    if (node->matches(i, key)) {
+                        out[base + g] = node->dead[i] ? nullptr : &node->records[i];
+                        cursor[g] = nullptr;
+                    } else if (node->isLeaf) {
+                        cursor[g] = nullptr;
+                    } else {
+                        cursor[g] = node->children[i];
+                        arraysRequested[g] = false;
+                        __builtin_prefetch(cursor[g]);
+                    }
+                }
+            }
+        }
+    }
+
+    void insert(const RecordT& rec) {
+        insertIntoRoot(rec);
+    }
+
+    void insert(RecordT&& rec) {
+        insertIntoRoot(std::move(rec));
+    }
+
+    // Construct the record from its constructor arguments and move it in
+    template<typename... Args>
+    void emplace(Args&&... args) {
+        insertIntoRoot(RecordT(std::forward<Args>(args)...));
+    }
+
+    // Insert a copied or moved record, splitting the root if it overflows
+    template<typename R>
+    void insertIntoRoot(R&& record);
+    void remove(const KeyType& key) {
+        RECORD_STATS_ONLY(StatsTimer timer(counters.removeLatency);)
         if (!root)
             return;
 
-        root->remove(id, maxKeys + 1);
+        if (!lazy)
+            root->remove(key);
+        else if (root->removeLazy(key))
+            tombstones++;
 
         // If the root has no keys, make its first child the new root
         if (root->records.empty()) {
             BTreeNode* tmp = root;
             root = root->isLeaf ? nullptr : root->children[0];
-            delete tmp;
+            arena.destroy(tmp);
         }
     }
-};
 
-void BTreeNode::remove(int id, int degree) {
-    int index = 0;
-    while (index < records.size() && records[index].id < id)
-        index++;
+    // Switch between eager removal (the default), which restructures the
+    // tree on every remove, and lazy removal, which only marks the record
+    // dead in a single descent, so no remove ever moves records. Dead records
+    // are dropped when a full leaf would otherwise split, and all at once by
+    // compact(), which the owner runs off the latency-critical path, e.g.
+    // once deadRecords() has grown. Switching back to eager removal compacts
+    // first.
+    void setLazyRemove(bool on) {
+        if (!on && tombstones > 0)
+            compact();
+        lazy = on;
+    }
 
-    if (index < records.size() && records[index].id == id) {
-        if (isLeaf) {
-            removeFromLeaf(index);
-        } else {
-            removeFromNonLeaf(index, degree);
+    bool lazyRemove() const {
+        return lazy;
+    }
+
+    // Number of dead records still stored
+    long deadRecords() const {
+        return tombstones;
+    }
+
+    // Rebuild the tree packed from its live records in one bottom-up pass
+    void compact() {
+        std::vector<RecordT> none;
+        bulkLoad(none.begin(), none.end());
+    }
+
+    ArenaStats arenaStats() const {
+        return arena.stats();
+    }
+
+    // Number of records in the tree
+    long size() const {
+        return root ? root->subtreeCount() : 0;
+    }
+
+    // Number of records whose key is smaller than key, i.e. the position key
+    // has or would have in sorted order
+    long rank(const KeyType& key) const {
+        return countBelow(key, false);
+    }
+
+    // The record at position k (0-based) in key order, or nullptr if k is out
+    // of range. Each level skips whole children by their counts.
+    RecordT* select(long k) {
+        if (k < 0 || k >= size())
+            return nullptr;
+        BTreeNode* node = root;
+        while (!node->isLeaf) {
+            int i = 0;
+            for (; i < node->size(); i++) {
+                if (k < node->childCounts[i])
+                    break;
+                k -= node->childCounts[i];
+                if (node->dead[i])
+                    continue;
+                if (k == 0)
+                    return &node->records[i];
+                k--;
+            }
+            node = node->children[i];
         }
-    } else {
-        if (isLeaf)
-            return; // Key not found
+        return &node->records[node->liveIndex(k)];
+    }
 
-        bool atLastChild = (index == records.size());
+    // Number of records with lo <= key <= hi
+    long countRange(const KeyType& lo, const KeyType& hi) const {
+        return Compare()(hi, lo) ? 0 : countBelow(hi, true) - countBelow(lo, false);
+    }
 
-        if (children[index]->records.size() < degree / 2)
-            fill(index, degree);
+    // Cursor at the smallest key
+    Cursor first() const {
+        Cursor c;
+        if (root)
+            c.descendFirst(root);
+        c.skipDeadForward();
+        return c;
+    }
 
-        if (atLastChild && index > records.size())
-            children[index - 1]->remove(id, degree);
-        else
-            children[index]->remove(id, degree);
+    // Cursor at the largest key
+    Cursor last() const {
+        Cursor c;
+        if (root)
+            c.descendLast(root);
+        c.skipDeadBackward();
+        return c;
     }
+
+    // Cursor at the first record whose key is not less than key
+    Cursor lowerBound(const KeyType& key) const {
+        Cursor c;
+        const BTreeNode* node = root;
+        while (node) {
+            int i = node->findIndex(key);
+            c.path.push_back({node, i});
+            if (node->matches(i, key) || node->isLeaf)
+                break;
+            node = node->children[i];
+        }
+        if (c.valid() && c.path.back().index == c.path.back().node->size())
+            c.ascendRight();
+        c.skipDeadForward();
+        return c;
+    }
+
+    // Call fn(const RecordT&) on every record with lo <= key <= hi, in key
+    // order and without copying. Returns the number of records visited.
+    // Leaves are swept as whole arrays, so a long scan reads memory in order
+    // instead of repeating a descent per record.
+    template<typename Fn>
+    size_t rangeScan(const KeyType& lo, const KeyType& hi, Fn&& fn) const {
+        size_t count = 0;
+        if (root && !Compare()(hi, lo))
+            scanNode(root, lo, hi, fn, count);
+        return count;
+    }
+
+    // Copy the records, in key order, into a frozen Eytzinger-layout index;
+    // the copy is independent of later updates to the tree
+    BasicFrozenIndex<RecordT, KeyOf, Compare> freeze() const {
+        std::vector<RecordT> recs;
+        if (root)
+            root->collectRecords(recs);
+        return BasicFrozenIndex<RecordT, KeyOf, Compare>(std::move(recs));
+    }
+
+    // Snapshot of the instrumentation counters; empty unless built with -DRECORD_STATS
+    IndexStats stats() const {
+#ifdef RECORD_STATS
+        return counters;
+#else
+        return IndexStats();
+#endif
+    }
+
+    void resetStats() {
+        RECORD_STATS_ONLY(counters = IndexStats();)
+    }
+
+private:
+    // Helper function to count the records with a key below key, or not
+    // above it if inclusive. Every level adds the records and child counts to
+    // the left of the descent.
+    long countBelow(const KeyType& key, bool inclusive) const {
+        long count = 0;
+        const BTreeNode* node = root;
+        while (node) {
+            int i = inclusive ? keyUpperBound<Compare>(node->keys.data(), node->size(), key) : node->findIndex(key);
+            count += node->liveBefore(i);
+            if (node->isLeaf)
+                break;
+            for (int j = 0; j < i; j++)
+                count += node->childCounts[j];
+            // On a match in an inner node the rest of the count is settled
+            if (inclusive) {
+                if (i > 0 && !Compare()(node->keys[i - 1], key))
+                    break;
+            } else if (node->matches(i, key)) {
+                count += node->childCounts[i];
+                break;
+            }
+            node = node->children[i];
+        }
+        return count;
+    }
+
+    // Helper function for rangeScan. Returns false once it has passed hi.
+    template<typename Fn>
+    static bool scanNode(const BTreeNode* node, const KeyType& lo, const KeyType& hi, Fn& fn, size_t& count) {
+        int i = node->findIndex(lo);
+        int n = node->size();
+
+        if (node->isLeaf) {
+            int end = keyUpperBound<Compare>(node->keys.data(), n, hi);
+            const RecordT* recs = node->records.data();
+            if (end > i)
+                count += node->liveBefore(end) - node->liveBefore(i);
+            for (; i < end; i++) {
+                if (node->deadCount == 0 || !node->dead[i])
+                    fn(recs[i]);
+            }
+            return end == n;
+        }
+
+        for (; i < n; i++) {
+            if (!scanNode(node->children[i], lo, hi, fn, count))
+                return false;
+            if (Compare()(hi, node->keys[i]))
+                return false;
+            if (!node->dead[i]) {
+                fn(node->records[i]);
+                count++;
+            }
+        }
+        return scanNode(node->children[n], lo, hi, fn, count);
+    }
+};
+
+template<typename RecordT, int Fanout, typename KeyOf, typename Compare>
+void BasicBTreeNode<RecordT, Fanout, KeyOf, Compare>::insertRecord(int index, RecordT record, bool isDead) {
+    keys.insert(keys.begin() + index, KeyOf()(record));
+    records.insert(records.begin() + index, std::move(record));
+    dead.insert(dead.begin() + index, isDead);
+    deadCount += isDead;
 }
 
-void BTreeNode::removeFromLeaf(int index) {
+template<typename RecordT, int Fanout, typename KeyOf, typename Compare>
+void BasicBTreeNode<RecordT, Fanout, KeyOf, Compare>::eraseRecord(int index) {
     records.erase(records.begin() + index);
+    keys.erase(keys.begin() + index);
+    deadCount -= dead[index];
+    dead.erase(dead.begin() + index);
+}
+
+template<typename RecordT, int Fanout, typename KeyOf, typename Compare>
+void BasicBTreeNode<RecordT, Fanout, KeyOf, Compare>::setRecord(int index, RecordT record, bool isDead) {
+    keys[index] = KeyOf()(record);
+    records[index] = std::move(record);
+    deadCount += (int)isDead - dead[index];
+    dead[index] = isDead;
+}
+
+template<typename RecordT, int Fanout, typename KeyOf, typename Compare>
+void BasicBTreeNode<RecordT, Fanout, KeyOf, Compare>::countDead() {
+    deadCount = (int)std::count(dead.begin(), dead.end(), 1);
+}
+
+template<typename RecordT, int Fanout, typename KeyOf, typename Compare>
+bool BasicBTreeNode<RecordT, Fanout, KeyOf, Compare>::remove(const KeyType& key) {
+    int index = findIndex(key);
+
+    if (matches(index, key)) {
+        if (isLeaf)
+            removeFromLeaf(index);
+        else
+            removeFromNonLeaf(index);
+        return true;
+    }
+
+    if (isLeaf)
+        return false; // Key not found
+
+    if (!children[index]->remove(key))
+        return false;
+
+    childCounts[index]--;
+    if (children[index]->size() < minKeys())
+        fill(index);
+    return true;
+}
+
+template<typename RecordT, int Fanout, typename KeyOf, typename Compare>
+void BasicBTreeNode<RecordT, Fanout, KeyOf, Compare>::removeFromLeaf(int index) {
+    eraseRecord(index);
 }
 
-void BTreeNode::removeFromNonLeaf(int index, int degree) {
-    int id = records[index].id;
-
-    if (children[index]->records.size() >= degree / 2) {
-        Record pred = getPredecessor(index);
-        records[index] = pred;
-        children[index]->remove(pred.id, degree);
-    } else if (children[index + 1]->records.size() >= degree / 2) {
-        Record succ = getSuccessor(index);
-        records[index] = succ;
-        children[index + 1]->remove(succ.id, degree);
-    } else {
-        merge(index);
-        children[index]->remove(id, degree);
+template<typename RecordT, int Fanout, typename KeyOf, typename Compare>
+void BasicBTreeNode<RecordT, Fanout, KeyOf, Compare>::removeFromNonLeaf(int index) {
+    // Move the neighbour from the larger side into the record's slot, then
+    // delete the emptied-out neighbour (it keeps its key) from its leaf
+    int child = children[index]->size() >= children[index + 1]->size() ? index : index + 1;
+    RecordT& replacement = child == index ? getPredecessor(index) : getSuccessor(index);
+    KeyType replacementKey = KeyOf()(replacement);
+    setRecord(index, std::move(replacement));
+    children[child]->remove(replacementKey);
+    childCounts[child]--;
+
+    if (children[child]->size() < minKeys())
+        fill(child);
+}
+
+template<typename RecordT, int Fanout, typename KeyOf, typename Compare>
+bool BasicBTreeNode<RecordT, Fanout, KeyOf, Compare>::removeLazy(const KeyType& key) {
+    int index = findIndex(key);
+
+    if (matches(index, key)) {
+        if (dead[index])
+            return false; // Already removed
+        dead[index] = 1;
+        deadCount++;
+        return true;
     }
+
+    if (isLeaf)
+        return false; // Key not found
+    if (!children[index]->removeLazy(key))
+        return false;
+
+    childCounts[index]--;
+    return true;
 }
 
-Record BTreeNode::getPredecessor(int index) {
-    BTreeNode* current = children[index];
+template<typename RecordT, int Fanout, typename KeyOf, typename Compare>
+void BasicBTreeNode<RecordT, Fanout, KeyOf, Compare>::purgeDead(long& tombstones) {
+    tombstones -= deadCount;
+    int kept = 0;
+    for (int i = 0; i < size(); i++) {
+        if (dead[i])
+            continue;
+        if (kept != i) {
+            records[kept] = std::move(records[i]);
+            keys[kept] = keys[i];
+            dead[kept] = 0;
+        }
+        kept++;
+    }
+    records.resize(kept);
+    keys.resize(kept);
+    dead.resize(kept);
+    deadCount = 0;
+}
+
+template<typename RecordT, int Fanout, typename KeyOf, typename Compare>
+RecordT& BasicBTreeNode<RecordT, Fanout, KeyOf, Compare>::getPredecessor(int index) {
+    BasicBTreeNode* current = children[index];
     while (!current->isLeaf)
-        current = current->children[current->records.size()];
+        current = current->children[current->size()];
     return current->records.back();
 }
 
-Record BTreeNode::getSuccessor(int index) {
-    BTreeNode* current = children[index + 1];
+template<typename RecordT, int Fanout, typename KeyOf, typename Compare>
+RecordT& BasicBTreeNode<RecordT, Fanout, KeyOf, Compare>::getSuccessor(int index) {
+    BasicBTreeNode* current = children[index + 1];
     while (!current->isLeaf)
         current = current->children[0];
     return current->records.front();
 }
 
-void BTreeNode::insertNonFull(Record record) {
-    int i = records.size() - 1;
+template<typename RecordT, int Fanout, typename KeyOf, typename Compare>
+template<typename R>
+bool BasicBTreeNode<RecordT, Fanout, KeyOf, Compare>::insert(R&& record, long& tombstones) {
+    KeyType key = KeyOf()(record);
+    int i = findIndex(key);
+
+    if (matches(i, key)) {
+        if (!dead[i])
+            return false; // Duplicate key, no insertion
+        setRecord(i, std::forward<R>(record));
+        tombstones--;
+        return true;
+    }
 
     if (isLeaf) {
-        records.push_back({0, "", 0}); // Extend size
-        while (i >= 0 && records[i].id > record.id) {
-            records[i + 1] = records[i];
-            i--;
-        }
-        records[i + 1] = record;
-    } else {
-        while (i >= 0 && records[i].id > record.id) {
-            i--;
-        }
-
-        if (children[i + 1]->records.size() == maxKeys) {
-            splitChild(i + 1, children[i + 1]);
-            if (records[i + 1].id < record.id) {
-                i++;
-            }
-        }
-        children[i + 1]->insertNonFull(record);
+        insertRecord(i, std::forward<R>(record));
+        return true;
     }
+
+    if (!children[i]->insert(std::forward<R>(record), tombstones))
+        return false;
+
+    childCounts[i]++;
+    // A full leaf drops its dead records instead of splitting, as long as
+    // enough live ones are left for it to stay at least half full
+    BasicBTreeNode* child = children[i];
+    if (child->isLeaf && child->size() > maxKeys && child->deadCount > 0 &&
+        child->size() - child->deadCount >= minKeys())
+        child->purgeDead(tombstones);
+    if (child->size() > maxKeys)
+        splitChild(i, child);
+    return true;
 }
 
-void BTreeNode::splitChild(int i, BTreeNode* child) {
-    int mid = maxKeys / 2;
-    BTreeNode* newChild = new BTreeNode(maxKeys, child->isLeaf);
+template<typename RecordT, int Fanout, typename KeyOf, typename Compare>
+void BasicBTreeNode<RecordT, Fanout, KeyOf, Compare>::splitChild(int i, BasicBTreeNode* child) {
+    int mid = child->size() / 2;
+    BasicBTreeNode* newChild = arena->create(maxKeys, child->isLeaf, arena);
+    RECORD_STATS_ONLY(newChild->stats = stats; stats->splits++;)
 
-    for (int j = mid + 1; j < child->records.size(); j++) {
-        newChild->records.push_back(child->records[j]);
-    }
+    newChild->records.assign(std::make_move_iterator(child->records.begin() + mid + 1),
+                             std::make_move_iterator(child->records.end()));
+    newChild->keys.assign(child->keys.begin() + mid + 1, child->keys.end());
+    newChild->dead.assign(child->dead.begin() + mid + 1, child->dead.end());
+    newChild->countDead();
 
     if (!child->isLeaf) {
-        for (int j = mid + 1; j <= child->records.size(); j++) {
-            newChild->children.push_back(child->children[j]);
-        }
+        newChild->children.assign(child->children.begin() + mid + 1, child->children.end());
+        newChild->childCounts.assign(child->childCounts.begin() + mid + 1, child->childCounts.end());
+        child->children.resize(mid + 1);
+        child->childCounts.resize(mid + 1);
     }
 
+    RecordT median = std::move(child->records[mid]);
+    bool medianDead = child->dead[mid];
     child->records.resize(mid);
-    if (!child->isLeaf) {
-        child->children.resize(mid + 1);
-    }
+    child->keys.resize(mid);
+    child->dead.resize(mid);
+    child->countDead();
 
+    long newCount = newChild->subtreeCount();
+    childCounts[i] -= newCount + !medianDead;
     children.insert(children.begin() + i + 1, newChild);
-    records.insert(records.begin() + i, child->records[mid]);
+    childCounts.insert(childCounts.begin() + i + 1, newCount);
+    insertRecord(i, std::move(median), medianDead);
 }
 
 
-void BTreeNode::merge(int index) {
-    BTreeNode* child = children[index];
-    BTreeNode* sibling = children[index + 1];
+template<typename RecordT, int Fanout, typename KeyOf, typename Compare>
+void BasicBTreeNode<RecordT, Fanout, KeyOf, Compare>::merge(int index) {
+    BasicBTreeNode* child = children[index];
+    BasicBTreeNode* sibling = children[index + 1];
+    RECORD_STATS_ONLY(stats->merges++;)
 
-    child->records.push_back(records[index]);
+    child->records.push_back(std::move(records[index]));
+    child->keys.push_back(keys[index]);
+    child->dead.push_back(dead[index]);
 
     for (auto& record : sibling->records)
-        child->records.push_back(record);
+        child->records.push_back(std::move(record));
+    child->keys.insert(child->keys.end(), sibling->keys.begin(), sibling->keys.end());
+    child->dead.insert(child->dead.end(), sibling->dead.begin(), sibling->dead.end());
+    child->deadCount += dead[index] + sibling->deadCount;
 
     if (!sibling->isLeaf) {
         for (auto& childPtr : sibling->children)
             child->children.push_back(childPtr);
+        child->childCounts.insert(child->childCounts.end(), sibling->childCounts.begin(), sibling->childCounts.end());
     }
 
-    records.erase(records.begin() + index);
+    childCounts[index] += !dead[index] + childCounts[index + 1];
+    eraseRecord(index);
     children.erase(children.begin() + index + 1);
+    childCounts.erase(childCounts.begin() + index + 1);
 
-    delete sibling;
+    arena->destroy(sibling);
 }
 
-void BTreeNode::fill(int index, int degree) {
-    if (index != 0 && children[index - 1]->records.size() >= degree / 2)
+template<typename RecordT, int Fanout, typename KeyOf, typename Compare>
+void BasicBTreeNode<RecordT, Fanout, KeyOf, Compare>::fill(int index) {
+    if (index != 0 && children[index - 1]->size() > minKeys())
         borrowFromPrev(index);
-    else if (index != records.size() && children[index + 1]->records.size() >= degree / 2)
+    else if (index != size() && children[index + 1]->size() > minKeys())
         borrowFromNext(index);
     else {
-        if (index != records.size())
+        if (index != size())
             merge(index);
         else
             merge(index - 1);
     }
 }
 
-void BTreeNode::borrowFromPrev(int index) {
-    BTreeNode* child = children[index];
-    BTreeNode* sibling = children[index - 1];
+template<typename RecordT, int Fanout, typename KeyOf, typename Compare>
+void BasicBTreeNode<RecordT, Fanout, KeyOf, Compare>::borrowFromPrev(int index) {
+    BasicBTreeNode* child = children[index];
+    BasicBTreeNode* sibling = children[index - 1];
+    RECORD_STATS_ONLY(stats->borrows++;)
 
-    child->records.insert(child->records.begin(), records[index - 1]);
-    records[index - 1] = sibling->records.back();
-    sibling->records.pop_back();
+    // The separator moves down into child and the sibling's last record up
+    // into its place; only live records count
+    long in = !dead[index - 1], out = !sibling->dead.back();
+    child->insertRecord(0, std::move(records[index - 1]), dead[index - 1]);
+    setRecord(index - 1, std::move(sibling->records.back()), sibling->dead.back());
+    sibling->eraseRecord(sibling->size() - 1);
 
+    long moved = 0;
     if (!child->isLeaf) {
+        moved = sibling->childCounts.back();
         child->children.insert(child->children.begin(), sibling->children.back());
+        child->childCounts.insert(child->childCounts.begin(), sibling->childCounts.back());
         sibling->children.pop_back();
+        sibling->childCounts.pop_back();
     }
+    childCounts[index] += in + moved;
+    childCounts[index - 1] -= out + moved;
 }
 
-void BTreeNode::borrowFromNext(int index) {
-    BTreeNode* child = children[index];
-    BTreeNode* sibling = children[index + 1];
+template<typename RecordT, int Fanout, typename KeyOf, typename Compare>
+void BasicBTreeNode<RecordT, Fanout, KeyOf, Compare>::borrowFromNext(int index) {
+    BasicBTreeNode* child = children[index];
+    BasicBTreeNode* sibling = children[index + 1];
+    RECORD_STATS_ONLY(stats->borrows++;)
 
-    child->records.push_back(records[index]);
-    records[index] = sibling->records.front();
-    sibling->records.erase(sibling->records.begin());
+    long in = !dead[index], out = !sibling->dead.front();
+    child->insertRecord(child->size(), std::move(records[index]), dead[index]);
+    setRecord(index, std::move(sibling->records.front()), sibling->dead.front());
+    sibling->eraseRecord(0);
 
+    long moved = 0;
     if (!child->isLeaf) {
+        moved = sibling->childCounts.front();
         child->children.push_back(sibling->children.front());
+        child->childCounts.push_back(sibling->childCounts.front());
         sibling->children.erase(sibling->children.begin());
+        sibling->childCounts.erase(sibling->childCounts.begin());
     }
+    childCounts[index] += in + moved;
+    childCounts[index + 1] -= out + moved;
 }
 
-void BTree::insert(Record record) {
+template<typename RecordT, int Fanout, typename KeyOf, typename Compare>
+template<typename R>
+void BasicBTree<RecordT, Fanout, KeyOf, Compare>::insertIntoRoot(R&& record) {
+    RECORD_STATS_ONLY(StatsTimer timer(counters.insertLatency);)
     if (!root) {
-        root = new BTreeNode(maxKeys, true);
-        root->records.push_back(record);
-    } else {
-        if (root->records.size() == maxKeys) {
-            BTreeNode* newRoot = new BTreeNode(maxKeys, false);
-            newRoot->children.push_back(root);
-            newRoot->splitChild(0, root);
-            root = newRoot;
-        }
-        root->insertNonFull(record);
+        root = arena.create(maxKeys, true, &arena);
+        RECORD_STATS_ONLY(root->stats = &counters;)
+        root->insertRecord(0, std::forward<R>(record));
+    } else if (root->insert(std::forward<R>(record), tombstones) && root->size() > maxKeys) {
+        if (root->isLeaf && root->deadCount > 0)
+            root->purgeDead(tombstones);
+        if (root->size() <= maxKeys)
+            return;
+        BTreeNode* newRoot = arena.create(maxKeys, false, &arena);
+        RECORD_STATS_ONLY(newRoot->stats = &counters;)
+        newRoot->children.push_back(root);
+        newRoot->childCounts.push_back(root->subtreeCount());
+        newRoot->splitChild(0, root);
+        root = newRoot;
     }
 }
 
+typedef BasicBTreeNode<Record> BTreeNode;
+typedef BasicBTree<Record> BTree;
+
 #endif
@@ -0,0 +1,505 @@
+#ifndef RECORD_DISK_BTREE_H
+#define RECORD_DISK_BTREE_H
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <system_error>
+#include <utility>
+#include <vector>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "RECORD.h"
+#include "NODE_SEARCH.h"
+#include "BULK_LOAD.h"
+
+// Persistent B+Tree that lives in a memory-mapped file.
+//
+// The file is a sequence of fixed-size pages. Page 0 is the header, and every
+// other page is one node. Nodes refer to their children by page number
+// instead of by pointer, and leaves hold CompactRecords (a fixed-width,
+// 16-byte encoding), so a node in the file has exactly the layout the code
+// reads. Opening an existing file maps it and validates the header, and
+// search() can run straight away with nothing to deserialize.
+//
+// Writes go to the shared mapping. Every page written is marked dirty, and
+// sync() writes the dirty pages back to the file and waits for them. Each
+// time enough new pages are dirty, writeback of them starts in the
+// background, but they stay dirty until the next sync() (or the destructor)
+// has waited for them: only a returned sync() makes records durable. The
+// format uses native byte order and is not crash-atomic: a crash between
+// syncs can leave a torn tree behind.
+
+const uint64_t DISK_BTREE_MAGIC = 0x3130584449434552ULL;    // "RECIDX01"
+const uint32_t DISK_BTREE_FORMAT = 1;
+const uint32_t DISK_BTREE_INITIAL_PAGES = 16;
+const size_t DISK_BTREE_SYNC_PAGES = 1024;                  // newly dirty pages before background writeback
+
+struct DiskHeaderPage {
+    uint64_t magic;
+    uint32_t format;
+    uint32_t pageSize;
+    uint32_t pageCount;              // pages in use; the file may be larger
+    uint32_t root;
+    uint32_t firstLeaf;
+    uint32_t height;
+    uint64_t recordCount;
+};
+
+template<int PageSize>
+struct DiskInnerPage {
+    static const int CAPACITY = (PageSize - 20) / 8;
+
+    uint32_t isLeaf;
+    uint32_t count;
+    uint32_t reserved[2];
+    int keys[CAPACITY];                  // keys[i] <= every id under children[i + 1]
+    uint32_t children[CAPACITY + 1];     // page numbers
+};
+
+template<int PageSize>
+struct DiskLeafPage {
+    static const int CAPACITY = (PageSize - 32) / 20;
+
+    uint32_t isLeaf;
+    uint32_t count;
+    uint32_t next;                       // page number of the next leaf, 0 at the end
+    uint32_t reserved;
+    int ids[CAPACITY];
+    CompactRecord records[CAPACITY];
+};
+
+// DiskBTree class
+template<int PageSize>
+class BasicDiskBTree {
+private:
+    typedef DiskInnerPage<PageSize> InnerPage;
+    typedef DiskLeafPage<PageSize> LeafPage;
+
+    static_assert(PageSize % 4096 == 0, "pages must be a multiple of the OS page size");
+    static_assert(sizeof(InnerPage) <= PageSize && sizeof(LeafPage) <= PageSize, "node does not fit its page");
+
+    int fd;
+    char* base;
+    uint32_t capacity;               // pages the file and the mapping hold
+    std::vector<uint64_t> dirty;     // one bit per page written since the last sync
+    size_t dirtyCount;
+    size_t startedCount;             // dirtyCount when background writeback last started
+
+    DiskHeaderPage* header() const {
+        return reinterpret_cast<DiskHeaderPage*>(base);
+    }
+
+    char* page(uint32_t n) const {
+        return base + (size_t)n * PageSize;
+    }
+
+    InnerPage* inner(uint32_t n) const {
+        return reinterpret_cast<InnerPage*>(page(n));
+    }
+
+    LeafPage* leaf(uint32_t n) const {
+        return reinterpret_cast<LeafPage*>(page(n));
+    }
+
+    // Both page kinds start with the isLeaf word
+    bool isLeafPage(uint32_t n) const {
+        return *reinterpret_cast<const uint32_t*>(page(n)) != 0;
+    }
+
+    bool isFull(uint32_t n) const {
+        return isLeafPage(n) ? (int)leaf(n)->count == LeafPage::CAPACITY
+                             : (int)inner(n)->count == InnerPage::CAPACITY;
+    }
+
+    void markDirty(uint32_t n) {
+        uint64_t bit = 1ULL << (n & 63);
+        if (!(dirty[n >> 6] & bit)) {
+            dirty[n >> 6] |= bit;
+            dirtyCount++;
+        }
+    }
+
+    // Helper function to call fn(first, pages) for every contiguous run of dirty pages
+    template<typename Fn>
+    void forEachDirtyRun(Fn&& fn) {
+        uint32_t n = 0;
+        while (n < capacity) {
+            if (!(dirty[n >> 6] & (1ULL << (n & 63)))) {
+                n++;
+                continue;
+            }
+            uint32_t start = n;
+            while (n < capacity && (dirty[n >> 6] & (1ULL << (n & 63))))
+                n++;
+            fn(start, n - start);
+        }
+    }
+
+    // Helper function to write back the dirty pages and wait for them, one msync per run
+    void flushDirty() {
+        forEachDirtyRun([&](uint32_t start, uint32_t pages) {
+            if (msync(page(start), (size_t)pages * PageSize, MS_SYNC) != 0)
+                throw std::system_error(errno, std::generic_category(), "msync");
+        });
+        std::fill(dirty.begin(), dirty.end(), 0);
+        dirtyCount = 0;
+        startedCount = 0;
+    }
+
+    // Start writeback of the dirty pages without waiting. MS_ASYNC schedules
+    // nothing on Linux, so there the file range is queued directly. The pages
+    // stay dirty for the next flushDirty() to wait on.
+    void maybeFlush() {
+        if (dirtyCount - startedCount < DISK_BTREE_SYNC_PAGES)
+            return;
+        forEachDirtyRun([&](uint32_t start, uint32_t pages) {
+#ifdef __linux__
+            if (sync_file_range(fd, (off_t)start * PageSize, (off_t)pages * PageSize, SYNC_FILE_RANGE_WRITE) != 0)
+                throw std::system_error(errno, std::generic_category(), "sync_file_range");
+#else
+            if (msync(page(start), (size_t)pages * PageSize, MS_ASYNC) != 0)
+                throw std::system_error(errno, std::generic_category(), "msync");
+#endif
+        });
+        startedCount = dirtyCount;
+    }
+
+    // Helper function to map the first `pages` pages of the file, replacing any old mapping.
+    // Every page pointer taken before this call is invalidated.
+    void mapFile(uint32_t pages) {
+        if (base)
+            munmap(base, (size_t)capacity * PageSize);
+        base = nullptr;
+        void* p = mmap(nullptr, (size_t)pages * PageSize, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        if (p == MAP_FAILED)
+            throw std::system_error(errno, std::generic_category(), "mmap");
+        base = static_cast<char*>(p);
+        capacity = pages;
+        dirty.resize((pages + 63) / 64, 0);
+    }
+
+    void grow(uint32_t pages) {
+        if (ftruncate(fd, (off_t)pages * PageSize) != 0)
+            throw std::system_error(errno, std::generic_category(), "ftruncate");
+        mapFile(pages);
+    }
+
+    // Helper function to take a zeroed page at the end of the file, doubling the file if needed
+    uint32_t allocPage() {
+        if (header()->pageCount == capacity)
+            grow(capacity * 2);
+        uint32_t n = header()->pageCount++;
+        std::memset(page(n), 0, PageSize);
+        markDirty(0);
+        markDirty(n);
+        return n;
+    }
+
+    // Helper function to lay out an empty tree (header and one empty root leaf) in a new file
+    void initEmpty() {
+        grow(DISK_BTREE_INITIAL_PAGES);
+        DiskHeaderPage* h = header();
+        std::memset(h, 0, PageSize);
+        h->magic = DISK_BTREE_MAGIC;
+        h->format = DISK_BTREE_FORMAT;
+        h->pageSize = PageSize;
+        h->pageCount = 1;
+        markDirty(0);
+
+        uint32_t root = allocPage();
+        leaf(root)->isLeaf = 1;
+        h = header();
+        h->root = root;
+        h->firstLeaf = root;
+        h->height = 1;
+    }
+
+    void openFile(const std::string& path) {
+        fd = ::open(path.c_str(), O_RDWR | O_CREAT, 0644);
+        if (fd < 0)
+            throw std::system_error(errno, std::generic_category(), "open " + path);
+
+        struct stat st;
+        if (fstat(fd, &st) != 0)
+            throw std::system_error(errno, std::generic_category(), "fstat " + path);
+
+        if (st.st_size == 0) {
+            initEmpty();
+            return;
+        }
+        if (st.st_size % PageSize != 0)
+            throw std::runtime_error(path + ": size is not a multiple of the page size");
+
+        mapFile((uint32_t)(st.st_size / PageSize));
+        const DiskHeaderPage* h = header();
+        if (h->magic != DISK_BTREE_MAGIC || h->format != DISK_BTREE_FORMAT)
+            throw std::runtime_error(path + ": not a DiskBTree file");
+        if (h->pageSize != (uint32_t)PageSize)
+            throw std::runtime_error(path + ": written with a different page size");
+    }
+
+    void release() {
+        if (base)
+            munmap(base, (size_t)capacity * PageSize);
+        if (fd >= 0)
+            ::close(fd);
+        base = nullptr;
+        fd = -1;
+    }
+
+    // Helper function to split the full child at index i of a non-full inner page
+    void splitChild(uint32_t parentNo, int i) {
+        uint32_t rightNo = allocPage();
+        InnerPage* parent = inner(parentNo);
+        uint32_t childNo = parent->children[i];
+        int sep;
+
+        if (isLeafPage(childNo)) {
+            LeafPage* left = leaf(childNo);
+            LeafPage* right = leaf(rightNo);
+            uint32_t half = left->count / 2;
+            right->isLeaf = 1;
+            right->count = left->count - half;
+            std::memcpy(right->ids, left->ids + half, right->count * sizeof(int));
+            std::memcpy(right->records, left->records + half, right->count * sizeof(CompactRecord));
+            left->count = half;
+            right->next = left->next;
+            left->next = rightNo;
+            sep = right->ids[0];
+        } else {
+            InnerPage* left = inner(childNo);
+            InnerPage* right = inner(rightNo);
+            uint32_t mid = left->count / 2;
+            sep = left->keys[mid];
+            right->count = left->count - mid - 1;
+            std::memcpy(right->keys, left->keys + mid + 1, right->count * sizeof(int));
+            std::memcpy(right->children, left->children + mid + 1, (right->count + 1) * sizeof(uint32_t));
+            left->count = mid;
+        }
+
+        std::memmove(parent->keys + i + 1, parent->keys + i, (parent->count - i) * sizeof(int));
+        std::memmove(parent->children + i + 2, parent->children + i + 1, (parent->count - i) * sizeof(uint32_t));
+        parent->keys[i] = sep;
+        parent->children[i + 1] = rightNo;
+        parent->count++;
+
+        markDirty(parentNo);
+        markDirty(childNo);
+    }
+
+    // Helper function to find the leaf page that would hold ID
+    uint32_t findLeaf(int ID) const {
+        uint32_t n = header()->root;
+        while (!isLeafPage(n)) {
+            const InnerPage* node = inner(n);
+            n = node->children[nodeUpperBound(node->keys, node->count, ID)];
+        }
+        return n;
+    }
+
+    std::vector<CompactRecord> collectRecords() const {
+        std::vector<CompactRecord> out;
+        out.reserve(header()->recordCount);
+        for (uint32_t n = header()->firstLeaf; n != 0; n = leaf(n)->next)
+            out.insert(out.end(), leaf(n)->records, leaf(n)->records + leaf(n)->count);
+        return out;
+    }
+
+public:
+    // Open the index stored at path, creating an empty one if the file does not exist
+    explicit BasicDiskBTree(const std::string& path) : fd(-1), base(nullptr), capacity(0), dirtyCount(0), startedCount(0) {
+        try {
+            openFile(path);
+        } catch (...) {
+            release();
+            throw;
+        }
+    }
+
+    ~BasicDiskBTree() {
+        if (base && dirtyCount) {
+            try {
+                flushDirty();
+            } catch (const std::exception& e) {
+                std::cerr << "DiskBTree: " << e.what() << std::endl;
+            }
+        }
+        release();
+    }
+
+    BasicDiskBTree(const BasicDiskBTree&) = delete;
+    BasicDiskBTree& operator=(const BasicDiskBTree&) = delete;
+
+    // Split full pages on the way down so the leaf always has room
+    void insert(const CompactRecord& rec) {
+        if (isFull(header()->root)) {
+            uint32_t oldRoot = header()->root;
+            uint32_t newRoot = allocPage();
+            inner(newRoot)->children[0] = oldRoot;
+            splitChild(newRoot, 0);
+            header()->root = newRoot;
+            header()->height++;
+        }
+
+        uint32_t n = header()->root;
+        while (!isLeafPage(n)) {
+            int i = nodeUpperBound(inner(n)->keys, inner(n)->count, rec.id);
+            if (isFull(inner(n)->children[i])) {
+                splitChild(n, i);
+                if (rec.id >= inner(n)->keys[i])
+                    i++;
+            }
+            n = inner(n)->children[i];
+        }
+
+        LeafPage* node = leaf(n);
+        int pos = nodeLowerBound(node->ids, node->count, rec.id);
+        if (pos < (int)node->count && node->ids[pos] == rec.id)
+            return;
+        std::memmove(node->ids + pos + 1, node->ids + pos, (node->count - pos) * sizeof(int));
+        std::memmove(node->records + pos + 1, node->records + pos, (node->count - pos) * sizeof(CompactRecord));
+        node->ids[pos] = rec.id;
+        node->records[pos] = rec;
+        node->count++;
+        header()->recordCount++;
+
+        markDirty(0);
+        markDirty(n);
+        maybeFlush();
+    }
+
+    void insert(const Record& rec) {
+        insert(CompactRecord(rec));
+    }
+
+    template<typename... Args>
+    void emplace(Args&&... args) {
+        insert(CompactRecord(std::forward<Args>(args)...));
+    }
+
+    // Returns a pointer into the mapping, valid until the next write to the tree
+    const CompactRecord* search(int ID) const {
+        const LeafPage* node = leaf(findLeaf(ID));
+        int pos = nodeLowerBound(node->ids, node->count, ID);
+        if (pos < (int)node->count && node->ids[pos] == ID)
+            return &node->records[pos];
+        return nullptr;
+    }
+
+    // Leaves are not merged when they underflow; bulkLoad() repacks the file
+    void remove(int ID) {
+        uint32_t n = findLeaf(ID);
+        LeafPage* node = leaf(n);
+        int pos = nodeLowerBound(node->ids, node->count, ID);
+        if (pos == (int)node->count || node->ids[pos] != ID)
+            return;
+        std::memmove(node->ids + pos, node->ids + pos + 1, (node->count - pos - 1) * sizeof(int));
+        std::memmove(node->records + pos, node->records + pos + 1, (node->count - pos - 1) * sizeof(CompactRecord));
+        node->count--;
+        header()->recordCount--;
+
+        markDirty(0);
+        markDirty(n);
+        maybeFlush();
+    }
+
+    // Merge [first, last) with the stored records and rewrite the file with full pages
+    template<typename It>
+    void bulkLoad(It first, It last) {
+        std::vector<CompactRecord> recs = mergeSortedRecords(collectRecords(), sortedUniqueRecords<CompactRecord>(first, last));
+
+        header()->pageCount = 1;
+        header()->recordCount = recs.size();
+        header()->height = 1;
+
+        // Leaf level: lows[j] is the smallest id under pages[j]
+        std::vector<uint32_t> pages;
+        std::vector<int> lows;
+        long n = (long)recs.size();
+        long k = n == 0 ? 1 : (n + LeafPage::CAPACITY - 1) / LeafPage::CAPACITY;
+        long pos = 0;
+        uint32_t prev = 0;
+        for (long j = 0; j < k; j++) {
+            long take = n / k + (j < n % k ? 1 : 0);
+            uint32_t p = allocPage();
+            LeafPage* node = leaf(p);
+            node->isLeaf = 1;
+            node->count = (uint32_t)take;
+            for (long t = 0; t < take; t++, pos++) {
+                node->ids[t] = recs[pos].id;
+                node->records[t] = recs[pos];
+            }
+            if (prev)
+                leaf(prev)->next = p;
+            prev = p;
+
+            pages.push_back(p);
+            lows.push_back(take ? node->ids[0] : 0);
+        }
+        header()->firstLeaf = pages[0];
+
+        // Inner levels: group children evenly, separating them by their lows
+        while (pages.size() > 1) {
+            long c = (long)pages.size();
+            long groups = (c + InnerPage::CAPACITY) / (InnerPage::CAPACITY + 1);
+            std::vector<uint32_t> parents;
+            std::vector<int> parentLows;
+            long child = 0;
+            for (long j = 0; j < groups; j++) {
+                long take = c / groups + (j < c % groups ? 1 : 0);
+                uint32_t p = allocPage();
+                InnerPage* node = inner(p);
+                node->count = (uint32_t)(take - 1);
+                for (long t = 0; t < take; t++, child++) {
+                    node->children[t] = pages[child];
+                    if (t > 0)
+                        node->keys[t - 1] = lows[child];
+                }
+                parents.push_back(p);
+                parentLows.push_back(lows[child - take]);
+            }
+            pages.swap(parents);
+            lows.swap(parentLows);
+            header()->height++;
+        }
+        header()->root = pages[0];
+        maybeFlush();
+    }
+
+    // Write every dirty page back to the file and wait for it to reach storage
+    void sync() {
+        flushDirty();
+    }
+
+    size_t size() const {
+        return header()->recordCount;
+    }
+
+    size_t pageCount() const {
+        return header()->pageCount;
+    }
+
+    int height() const {
+        return header()->height;
+    }
+
+    void traverse() const {
+        for (uint32_t n = header()->firstLeaf; n != 0; n = leaf(n)->next) {
+            for (uint32_t j = 0; j < leaf(n)->count; j++)
+                std::cout << leaf(n)->records[j] << std::endl;
+        }
+        std::cout << std::endl;
+    }
+};
+
+typedef BasicDiskBTree<4096> DiskBTree;
+typedef BasicDiskBTree<16384> DiskBTree16K;
+
+#endif
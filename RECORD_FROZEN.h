@@ -0,0 +1,154 @@
+#ifndef RECORD_FROZEN_H
+#define RECORD_FROZEN_H
+
+#include <cstddef>
+#include <new>
+#include <utility>
+#include <vector>
+#include "RECORD.h"
+#include "INDEX_POLICY.h"
+#include "NODE_SEARCH.h"
+
+// Immutable snapshot of an ordered index, produced by freeze() on the BST,
+// AVL and BTree, for phases where a table is only read.
+//
+// Keys are stored in one contiguous array in Eytzinger (BFS) order: the
+// root at index 1 and the children of node k at 2k and 2k + 1, with the
+// records in a parallel array in the same order. A search walks down with
+// k = 2k + (keys[k] < key), so each step is a compare feeding an index
+// computation instead of a branch, and it prefetches the cache line holding
+// node k's descendants four levels down, which for int keys are the 16
+// consecutive slots from 16k. When the walk falls off the tree, the trailing
+// right turns are undone with one bit scan to find the lower bound.
+//
+// Record pointers stay valid for the life of the snapshot.
+
+// Allocator handing out cache-line-aligned storage, so the 16-key blocks the
+// search prefetches each start a line
+template<typename T>
+struct CacheAlignedAllocator {
+    typedef T value_type;
+
+    CacheAlignedAllocator() = default;
+
+    template<typename U>
+    CacheAlignedAllocator(const CacheAlignedAllocator<U>&) {}
+
+    T* allocate(size_t n) {
+        return static_cast<T*>(::operator new(n * sizeof(T), std::align_val_t(64)));
+    }
+
+    void deallocate(T* p, size_t) {
+        ::operator delete(p, std::align_val_t(64));
+    }
+
+    template<typename U>
+    bool operator==(const CacheAlignedAllocator<U>&) const { return true; }
+
+    template<typename U>
+    bool operator!=(const CacheAlignedAllocator<U>&) const { return false; }
+};
+
+template<typename RecordT, typename KeyOf = RecordId, typename Compare = std::less<IndexKey<RecordT, KeyOf>>>
+class BasicFrozenIndex {
+public:
+    typedef RecordT RecordType;
+    typedef IndexKey<RecordT, KeyOf> KeyType;
+
+private:
+    // Keys per cache line, the block of descendants prefetched four levels ahead
+    static constexpr size_t BLOCK = sizeof(KeyType) < 64 ? 64 / sizeof(KeyType) : 1;
+
+    size_t n;
+    std::vector<KeyType, CacheAlignedAllocator<KeyType>> keys;     // keys[1..n]; keys[0] unused
+    std::vector<RecordT> records;                                   // records[k] has keys[k]
+
+    static KeyType keyOf(const RecordT& rec) {
+        return KeyOf()(rec);
+    }
+
+    static bool less(const KeyType& a, const KeyType& b) {
+        return Compare()(a, b);
+    }
+
+    // Helper function to place sorted[pos...] into the subtree rooted at k by an in-order walk
+    void place(std::vector<RecordT>& sorted, size_t& pos, size_t k) {
+        if (k > n)
+            return;
+        place(sorted, pos, 2 * k);
+        keys[k] = keyOf(sorted[pos]);
+        records[k] = std::move(sorted[pos]);
+        pos++;
+        place(sorted, pos, 2 * k + 1);
+    }
+
+    // Helper function to turn the final index of a walk into the lower
+    // bound's index: strip the right turns taken after the last left turn
+    static size_t lowerBoundIndex(size_t k) {
+        return k >> __builtin_ffsll((long long)~k);
+    }
+
+    // Helper function to check the lower bound at index k against key
+    const RecordT* matchAt(size_t k, const KeyType& key) const {
+        return k != 0 && !less(key, keys[k]) ? &records[k] : nullptr;
+    }
+
+public:
+    BasicFrozenIndex() : n(0), keys(1), records(1) {}
+
+    // Build from records already sorted by key with no duplicates
+    explicit BasicFrozenIndex(std::vector<RecordT> sorted)
+        : n(sorted.size()), keys(sorted.size() + 1), records(sorted.size() + 1) {
+        size_t pos = 0;
+        place(sorted, pos, 1);
+    }
+
+    const RecordT* search(const KeyType& key) const {
+        const KeyType* k0 = keys.data();
+        size_t k = 1;
+        while (k <= n) {
+            __builtin_prefetch(k0 + BLOCK * k);
+            k = 2 * k + less(k0[k], key);
+        }
+        return matchAt(lowerBoundIndex(k), key);
+    }
+
+    bool contains(const KeyType& key) const {
+        return search(key) != nullptr;
+    }
+
+    // Look up n keys at once, storing each record (or nullptr) in out. The
+    // walks of a group advance one level per round, so their cache misses
+    // overlap.
+    void searchBatch(const KeyType* batch, size_t count, const RecordT** out) const {
+        const KeyType* k0 = keys.data();
+        size_t cursor[SEARCH_BATCH_GROUP];
+        for (size_t base = 0; base < count; base += SEARCH_BATCH_GROUP) {
+            int group = count - base < (size_t)SEARCH_BATCH_GROUP ? (int)(count - base) : SEARCH_BATCH_GROUP;
+            for (int g = 0; g < group; g++)
+                cursor[g] = 1;
+
+            // Every walk takes the same number of steps, give or take the last level
+            for (bool active = n > 0; active;) {
+                active = false;
+                for (int g = 0; g < group; g++) {
+                    size_t k = cursor[g];
+                    if (k > n)
+                        continue;
+                    k = 2 * k + less(k0[k], batch[base + g]);
+                    __builtin_prefetch(k0 + BLOCK * k);
+                    cursor[g] = k;
+                    active |= k <= n;
+                }
+            }
+            for (int g = 0; g < group; g++)
+                out[base + g] = matchAt(lowerBoundIndex(cursor[g]), batch[base + g]);
+        }
+    }
+
+    size_t size() const {
+        return n;
+    }
+};
+
+#endif
@@ -0,0 +1,392 @@
+#ifndef RECORD_HASH_H
+#define RECORD_HASH_H
+
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+#include <new>
+#include <type_traits>
+#include <utility>
+#include <vector>
+#include "RECORD.h"
+#include "BULK_LOAD.h"
+#include "NODE_ARENA.h"
+#include "NODE_SEARCH.h"
+#include "RECORD_STATS.h"
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+// Open-addressing hash index in the style of SwissTable, for workloads that
+// only need exact-id search, insert and remove.
+//
+// Slots are split into groups of 16. Each slot has one control byte: EMPTY,
+// DELETED, or the low 7 bits of the id's hash when full. A probe loads a
+// whole group of control bytes and compares them against those 7 bits at
+// once, so it only touches a record when 1 in 128 unrelated slots match. The
+// high hash bits pick the first group and the probe then moves to further
+// groups in triangular steps, which visit every group of a power-of-two
+// table. A search stops at the first group that still has an EMPTY slot.
+//
+// The table grows by doubling once full and deleted slots reach 7/8 of the
+// capacity; if most of those are deletions it is rehashed at the same size
+// instead.
+
+const int HASH_GROUP_WIDTH = 16;
+
+// Group of 16 control bytes with the three queries a probe needs, each
+// answered as a bitmask of matching slots
+class HashGroup {
+public:
+    static const signed char EMPTY = -128;    // 0b10000000
+    static const signed char DELETED = -2;    // 0b11111110
+
+private:
+#ifdef __SSE2__
+    __m128i ctrl;
+#else
+    signed char ctrl[HASH_GROUP_WIDTH];
+#endif
+
+public:
+    explicit HashGroup(const signed char* pos) {
+#ifdef __SSE2__
+        ctrl = _mm_load_si128(reinterpret_cast<const __m128i*>(pos));
+#else
+        std::memcpy(ctrl, pos, HASH_GROUP_WIDTH);
+#endif
+    }
+
+    // Slots whose control byte equals h2
+    uint32_t match(signed char h2) const {
+#ifdef __SSE2__
+        return (uint32_t)_mm_movemask_epi8(_mm_cmpeq_epi8(ctrl, _mm_set1_epi8(h2)));
+#else
+        uint32_t mask = 0;
+        for (int i = 0; i < HASH_GROUP_WIDTH; i++)
+            mask |= (uint32_t)(ctrl[i] == h2) << i;
+        return mask;
+#endif
+    }
+
+    uint32_t matchEmpty() const {
+        return match(EMPTY);
+    }
+
+    // EMPTY and DELETED are the only control bytes with the top bit set
+    uint32_t matchEmptyOrDeleted() const {
+#ifdef __SSE2__
+        return (uint32_t)_mm_movemask_epi8(ctrl);
+#else
+        uint32_t mask = 0;
+        for (int i = 0; i < HASH_GROUP_WIDTH; i++)
+            mask |= (uint32_t)(ctrl[i] < 0) << i;
+        return mask;
+#endif
+    }
+};
+
+// HashIndex class, storing Record or CompactRecord
+template<typename RecordT>
+class BasicHashIndex {
+public:
+    typedef RecordT RecordType;
+    typedef int KeyType;
+
+private:
+    static const size_t MIN_CAPACITY = HASH_GROUP_WIDTH;
+
+    signed char* ctrl;     // One control byte per slot, 16-byte aligned
+    RecordT* slots;        // Raw storage; only slots with a full control byte hold a record
+    size_t capacity;       // Always a power of two, and a multiple of HASH_GROUP_WIDTH
+    size_t count;          // Full slots
+    size_t deleted;        // DELETED slots, which still lengthen probes
+#ifdef RECORD_STATS
+    mutable IndexStats counters;
+#endif
+
+    // Helper function to mix an id into 64 well-spread bits (murmur3 finalizer)
+    static uint64_t hashId(int id) {
+        uint64_t h = (uint64_t)(uint32_t)id;
+        h ^= h >> 33;
+        h *= 0xff51afd7ed558ccdULL;
+        h ^= h >> 33;
+        h *= 0xc4ceb9fe1a85ec53ULL;
+        h ^= h >> 33;
+        return h;
+    }
+
+    static signed char h2(uint64_t hash) {
+        return (signed char)(hash & 0x7f);
+    }
+
+    size_t groupMask() const {
+        return capacity / HASH_GROUP_WIDTH - 1;
+    }
+
+    size_t firstGroup(uint64_t hash) const {
+        return (size_t)(hash >> 7) & groupMask();
+    }
+
+    // Helper function to allocate an all-EMPTY table of the given capacity
+    void allocate(size_t cap) {
+        capacity = cap;
+        ctrl = static_cast<signed char*>(::operator new(cap, std::align_val_t(HASH_GROUP_WIDTH)));
+        std::memset(ctrl, HashGroup::EMPTY, cap);
+        slots = static_cast<RecordT*>(::operator new(cap * sizeof(RecordT), std::align_val_t(alignof(RecordT))));
+        count = 0;
+        deleted = 0;
+    }
+
+    // Helper function to destroy every record and free the arrays
+    void release() {
+        if (!ctrl)
+            return;
+        if constexpr (!std::is_trivially_destructible<RecordT>::value) {
+            for (size_t i = 0; i < capacity; i++) {
+                if (ctrl[i] >= 0)
+                    slots[i].~RecordT();
+            }
+        }
+        ::operator delete(ctrl, std::align_val_t(HASH_GROUP_WIDTH));
+        ::operator delete(slots, std::align_val_t(alignof(RecordT)));
+        ctrl = nullptr;
+        slots = nullptr;
+        capacity = count = deleted = 0;
+    }
+
+    // Helper function to find the slot holding id, or -1. groups is bumped
+    // once per control group probed.
+    long findSlot(int id, uint64_t& groups) const {
+        if (!ctrl)
+            return -1;
+        uint64_t hash = hashId(id);
+        signed char tag = h2(hash);
+        size_t g = firstGroup(hash);
+        for (size_t step = 1;; step++) {
+            groups++;
+            size_t base = g * HASH_GROUP_WIDTH;
+            HashGroup group(ctrl + base);
+            for (uint32_t m = group.match(tag); m != 0; m &= m - 1) {
+                size_t i = base + __builtin_ctz(m);
+                if (slots[i].id == id)
+                    return (long)i;
+            }
+            if (group.matchEmpty())
+                return -1;
+            g = (g + step) & groupMask();
+        }
+    }
+
+    long findSlot(int id) const {
+        uint64_t groups = 0;
+        return findSlot(id, groups);
+    }
+
+    // Helper function to find the first EMPTY or DELETED slot on id's probe
+    // sequence. The table always has one, since it never fills completely.
+    size_t findFreeSlot(uint64_t hash) const {
+        size_t g = firstGroup(hash);
+        for (size_t step = 1;; step++) {
+            size_t base = g * HASH_GROUP_WIDTH;
+            uint32_t m = HashGroup(ctrl + base).matchEmptyOrDeleted();
+            if (m != 0)
+                return base + __builtin_ctz(m);
+            g = (g + step) & groupMask();
+        }
+    }
+
+    // Helper function to place a record known not to be in the table
+    template<typename R>
+    void insertUnique(R&& rec) {
+        uint64_t hash = hashId(rec.id);
+        size_t i = findFreeSlot(hash);
+        if (ctrl[i] == HashGroup::DELETED)
+            deleted--;
+        ctrl[i] = h2(hash);
+        new (&slots[i]) RecordT(std::forward<R>(rec));
+        count++;
+    }
+
+    // Helper function to move every record into a fresh table of capacity cap
+    void rehash(size_t cap) {
+        signed char* oldCtrl = ctrl;
+        RecordT* oldSlots = slots;
+        size_t oldCapacity = capacity;
+
+        allocate(cap);
+        for (size_t i = 0; i < oldCapacity; i++) {
+            if (oldCtrl[i] >= 0) {
+                insertUnique(std::move(oldSlots[i]));
+                oldSlots[i].~RecordT();
+            }
+        }
+        ::operator delete(oldCtrl, std::align_val_t(HASH_GROUP_WIDTH));
+        ::operator delete(oldSlots, std::align_val_t(alignof(RecordT)));
+    }
+
+    // Helper function to make room for one more record
+    void reserveOne() {
+        if (!ctrl) {
+            allocate(MIN_CAPACITY);
+            return;
+        }
+        if ((count + deleted + 1) * 8 <= capacity * 7)
+            return;
+        // Mostly tombstones: clean them out without growing
+        rehash(count * 2 < capacity ? capacity : capacity * 2);
+    }
+
+    // Helper function for insertion; a duplicate id keeps the existing record
+    template<typename R>
+    void insertRecord(R&& rec) {
+        RECORD_STATS_ONLY(StatsTimer timer(counters.insertLatency);)
+        if (findSlot(rec.id) >= 0)
+            return;
+        reserveOne();
+        insertUnique(std::forward<R>(rec));
+    }
+
+public:
+    BasicHashIndex() : ctrl(nullptr), slots(nullptr), capacity(0), count(0), deleted(0) {}
+
+    ~BasicHashIndex() {
+        release();
+    }
+
+    BasicHashIndex(const BasicHashIndex&) = delete;
+    BasicHashIndex& operator=(const BasicHashIndex&) = delete;
+
+    void insert(const RecordT& rec) {
+        insertRecord(rec);
+    }
+
+    void insert(RecordT&& rec) {
+        insertRecord(std::move(rec));
+    }
+
+    // Construct the record from its constructor arguments and move it in
+    template<typename... Args>
+    void emplace(Args&&... args) {
+        insertRecord(RecordT(std::forward<Args>(args)...));
+    }
+
+    // Size the table once for the combined record count and insert the
+    // batch, so loading n records rehashes at most once. Duplicate ids
+    // resolve as if inserted one by one.
+    template<typename It>
+    void bulkLoad(It first, It last) {
+        std::vector<RecordT> recs = sortedUniqueRecords<RecordT>(first, last);
+        reserve(count + recs.size());
+        for (RecordT& rec : recs) {
+            if (findSlot(rec.id) < 0)
+                insertUnique(std::move(rec));
+        }
+    }
+
+    // Grow the table (or clear its tombstones) so that n records fit
+    // without further rehashing
+    void reserve(size_t n) {
+        size_t cap = MIN_CAPACITY;
+        while (n * 8 > cap * 7)
+            cap *= 2;
+        if (!ctrl)
+            allocate(cap);
+        else if (cap > capacity || (n + deleted) * 8 > capacity * 7)
+            rehash(cap > capacity ? cap : capacity);
+    }
+
+    RecordT* search(int id) {
+        RECORD_STATS_ONLY(StatsTimer timer(counters.searchLatency); uint64_t before = counters.nodesVisited;)
+        uint64_t groups = 0;
+        long i = findSlot(id, groups);
+        RECORD_STATS_ONLY(counters.nodesVisited += groups; recordSearchVisits(counters, before);)
+        return i >= 0 ? &slots[i] : nullptr;
+    }
+
+    // Look up n ids at once, storing each record (or nullptr) in out. The
+    // first control group of every key in a batch is prefetched before any
+    // of them is probed, so the cache misses of the batch overlap.
+    void searchBatch(const int* ids, size_t n, RecordT** out) {
+        if (!ctrl) {
+            for (size_t i = 0; i < n; i++)
+                out[i] = nullptr;
+            return;
+        }
+        for (size_t base = 0; base < n; base += SEARCH_BATCH_GROUP) {
+            size_t group = n - base < (size_t)SEARCH_BATCH_GROUP ? n - base : (size_t)SEARCH_BATCH_GROUP;
+            for (size_t g = 0; g < group; g++) {
+                size_t first = firstGroup(hashId(ids[base + g])) * HASH_GROUP_WIDTH;
+                __builtin_prefetch(ctrl + first);
+                __builtin_prefetch(slots + first);
+            }
+            for (size_t g = 0; g < group; g++) {
+                long i = findSlot(ids[base + g]);
+                out[base + g] = i >= 0 ? &slots[i] : nullptr;
+            }
+        }
+    }
+
+    // Remove a record by id. A slot in a group that still has an EMPTY slot
+    // goes straight back to EMPTY, since no probe can have passed over that
+    // group; otherwise it becomes a DELETED tombstone.
+    void remove(int id) {
+        RECORD_STATS_ONLY(StatsTimer timer(counters.removeLatency);)
+        long i = findSlot(id);
+        if (i < 0)
+            return;
+        slots[i].~RecordT();
+        count--;
+        size_t base = (size_t)i & ~(size_t)(HASH_GROUP_WIDTH - 1);
+        if (HashGroup(ctrl + base).matchEmpty()) {
+            ctrl[i] = HashGroup::EMPTY;
+        } else {
+            ctrl[i] = HashGroup::DELETED;
+            deleted++;
+        }
+    }
+
+    size_t size() const {
+        return count;
+    }
+
+    // Print all records in slot order (not id order)
+    void print() const {
+        for (size_t i = 0; i < capacity; i++) {
+            if (ctrl[i] >= 0)
+                std::cout << slots[i] << std::endl;
+        }
+    }
+
+    // The table is one allocation rather than an arena; report it in the same
+    // shape, with slots as nodes and tombstones as the free list
+    ArenaStats arenaStats() const {
+        ArenaStats s;
+        s.chunks = ctrl ? 1 : 0;
+        s.reservedNodes = capacity;
+        s.liveNodes = count;
+        s.freeListNodes = deleted;
+        s.nodeBytes = sizeof(RecordT) + 1;
+        s.reservedBytes = capacity * (sizeof(RecordT) + 1);
+        return s;
+    }
+
+    // Snapshot of the instrumentation counters; empty unless built with
+    // -DRECORD_STATS. nodesVisited counts control groups probed.
+    IndexStats stats() const {
+#ifdef RECORD_STATS
+        return counters;
+#else
+        return IndexStats();
+#endif
+    }
+
+    void resetStats() {
+        RECORD_STATS_ONLY(counters = IndexStats();)
+    }
+};
+
+typedef BasicHashIndex<Record> HashIndex;
+
+#endif
@@ -0,0 +1,398 @@
+#ifndef RECORD_INGEST_H
+#define RECORD_INGEST_H
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <climits>
+#include <cstdint>
+#include <cstring>
+#include <iterator>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <system_error>
+#include <thread>
+#include <type_traits>
+#include <utility>
+#include <vector>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "RECORD.h"
+#include "RECORD_WAL.h"
+
+// Bulk ingest of id/name/age rows from a file into any of the indexes.
+//
+// The file is mapped read-only and parsed in batches of about batchBytes.
+// Each batch is cut into one chunk per thread on row boundaries. Every
+// thread parses its chunk straight from the mapping, building each record
+// from views into the file with no intermediate strings, and sorts its rows
+// by id. The sorted chunks are then merged pairwise, also in parallel, and
+// the batch goes to the index through bulkLoad(), which builds bottom-up
+// from a sorted run. Merges are stable in file order, so duplicate ids
+// resolve as the index's own bulkLoad() resolves them: the first row in the
+// file wins for the trees and the hash index, the last one for the LSM index,
+// as with a sequence of insert() calls into each.
+//
+// Each bulkLoad() after the first merges the batch with the records already
+// in the index and rebuilds it, so batchBytes trades the memory held by a
+// parsed batch against the number of rebuilds.
+//
+// Two formats are read:
+//  - CSV: one "id,name,age" row per line, with '\n' or "\r\n" endings.
+//    Names cannot contain commas and there is no quoting. Lines that do not
+//    parse, such as a header, are skipped and counted.
+//  - Binary: INGEST_MAGIC followed by rows in the snapshot encoding of
+//    RECORD_WAL.h (int32 id, int32 age, uint16 name length, name bytes).
+//    A truncated row is an error.
+// The format is told apart by the magic number.
+
+const uint64_t INGEST_MAGIC = 0x3130574F52434552ULL;       // "RECROW01"
+const size_t INGEST_DEFAULT_BATCH = 128 * 1024 * 1024;
+
+struct IngestOptions {
+    int threads = 0;                                // parser threads; 0 means one per core
+    size_t batchBytes = INGEST_DEFAULT_BATCH;       // file bytes parsed per bulkLoad() call
+};
+
+// Counters returned by ingestFile()
+struct IngestReport {
+    bool binary = false;
+    size_t rows = 0;                // rows parsed and handed to the index
+    size_t skipped = 0;             // CSV lines that did not parse
+    size_t bytes = 0;               // size of the file
+    size_t batches = 0;
+    double parseSeconds = 0;        // parsing, sorting and merging
+    double loadSeconds = 0;         // bulkLoad() calls
+
+    double seconds() const {
+        return parseSeconds + loadSeconds;
+    }
+
+    double rowsPerSecond() const {
+        return seconds() > 0 ? rows / seconds() : 0;
+    }
+
+    double bytesPerSecond() const {
+        return seconds() > 0 ? bytes / seconds() : 0;
+    }
+};
+
+// Read-only mapping of a whole file, unmapped on destruction
+class MappedFile {
+private:
+    const char* base;
+    size_t length;
+
+public:
+    explicit MappedFile(const std::string& path) : base(nullptr), length(0) {
+        int fd = ::open(path.c_str(), O_RDONLY);
+        if (fd < 0)
+            throw std::system_error(errno, std::generic_category(), "open " + path);
+        struct stat st;
+        if (fstat(fd, &st) != 0) {
+            int err = errno;
+            ::close(fd);
+            throw std::system_error(err, std::generic_category(), "fstat " + path);
+        }
+        length = (size_t)st.st_size;
+        if (length > 0) {
+            void* p = mmap(nullptr, length, PROT_READ, MAP_PRIVATE, fd, 0);
+            if (p == MAP_FAILED) {
+                int err = errno;
+                ::close(fd);
+                throw std::system_error(err, std::generic_category(), "mmap " + path);
+            }
+            // Batches are read front to back; let the kernel read ahead
+            madvise(p, length, MADV_SEQUENTIAL);
+            base = static_cast<const char*>(p);
+        }
+        ::close(fd);
+    }
+
+    ~MappedFile() {
+        if (base)
+            munmap(const_cast<char*>(base), length);
+    }
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    const char* data() const {
+        return base;
+    }
+
+    size_t size() const {
+        return length;
+    }
+};
+
+// Helper function to build a record from parsed fields. Only Record keeps
+// its own copy of the name; CompactRecord copies it from the view.
+template<typename RecordT>
+RecordT makeIngestRecord(int id, std::string_view name, int age) {
+    if constexpr (std::is_constructible<RecordT, int, std::string_view, int>::value)
+        return RecordT(id, name, age);
+    else
+        return RecordT(id, std::string(name), age);
+}
+
+// Helper function to parse a decimal int at p, stopping before end or the
+// first non-digit; returns false if there are no digits or it overflows
+inline bool parseIngestInt(const char*& p, const char* end, int& out) {
+    bool negative = p < end && *p == '-';
+    if (negative)
+        p++;
+    const char* start = p;
+    int64_t value = 0;
+    for (; p < end && *p >= '0' && *p <= '9'; p++) {
+        value = value * 10 + (*p - '0');
+        if (value > (int64_t)INT_MAX + 1)
+            return false;
+    }
+    if (p == start || (!negative && value > INT_MAX))
+        return false;
+    out = (int)(negative ? -value : value);
+    return true;
+}
+
+// Helper function to parse one CSV line [p, eol) without its newline
+template<typename RecordT>
+bool parseCsvRow(const char* p, const char* eol, RecordT& out) {
+    if (eol > p && eol[-1] == '\r')
+        eol--;
+    int id, age;
+    if (!parseIngestInt(p, eol, id) || p == eol || *p++ != ',')
+        return false;
+    const char* comma = static_cast<const char*>(std::memchr(p, ',', eol - p));
+    if (comma == nullptr)
+        return false;
+    std::string_view name(p, comma - p);
+    p = comma + 1;
+    if (!parseIngestInt(p, eol, age) || p != eol)
+        return false;
+    out = makeIngestRecord<RecordT>(id, name, age);
+    return true;
+}
+
+// Helper function to parse the CSV lines of [p, end), which starts on a line
+template<typename RecordT>
+void parseCsvChunk(const char* p, const char* end, std::vector<RecordT>& out, size_t& skipped) {
+    out.reserve(out.size() + (end - p) / 16);
+    RecordT rec;
+    while (p < end) {
+        const char* eol = static_cast<const char*>(std::memchr(p, '\n', end - p));
+        if (eol == nullptr)
+            eol = end;
+        if (parseCsvRow(p, eol, rec))
+            out.push_back(std::move(rec));
+        else if (eol - p > 1 || (eol - p == 1 && *p != '\r'))
+            skipped++;       // blank lines are not counted
+        p = eol + 1;
+    }
+}
+
+// Helper function to decode the binary rows of [p, end), which holds whole rows
+template<typename RecordT>
+void parseBinaryChunk(const char* p, const char* end, std::vector<RecordT>& out) {
+    while (p < end) {
+        int32_t id, age;
+        uint16_t len;
+        std::memcpy(&id, p, 4);
+        std::memcpy(&age, p + 4, 4);
+        std::memcpy(&len, p + 8, 2);
+        out.push_back(makeIngestRecord<RecordT>(id, std::string_view(p + 10, len), age));
+        p += 10 + len;
+    }
+}
+
+// Helper function to sort a chunk's rows by id, keeping file order among
+// equal ids. The sort runs over (id, position) pairs, which are cheap to
+// swap, and then each record is moved once into place.
+template<typename RecordT>
+void sortIngestRun(std::vector<RecordT>& run) {
+    std::vector<std::pair<int, uint32_t>> order(run.size());
+    for (size_t i = 0; i < run.size(); i++)
+        order[i] = {run[i].id, (uint32_t)i};
+    std::sort(order.begin(), order.end());
+    std::vector<RecordT> sorted;
+    sorted.reserve(run.size());
+    for (const auto& o : order)
+        sorted.push_back(std::move(run[o.second]));
+    run.swap(sorted);
+}
+
+// Helper function to run fn(i) for every i < n, each on its own thread
+template<typename Fn>
+void ingestParallel(size_t n, Fn fn) {
+    if (n == 1) {
+        fn(0);
+        return;
+    }
+    std::vector<std::thread> workers;
+    for (size_t i = 1; i < n; i++)
+        workers.emplace_back(fn, i);
+    fn(0);
+    for (std::thread& t : workers)
+        t.join();
+}
+
+// Helper function to cut one batch of CSV text, starting at begin, into up
+// to parts chunks; returns the chunk bounds, ending where the batch ends
+inline std::vector<const char*> csvBatchBounds(const char* begin, const char* end, size_t batchBytes, size_t parts) {
+    auto nextLine = [end](const char* p) {
+        if (p >= end)
+            return end;
+        const char* eol = static_cast<const char*>(std::memchr(p, '\n', end - p));
+        return eol ? eol + 1 : end;
+    };
+    const char* batchEnd = (size_t)(end - begin) <= batchBytes ? end : nextLine(begin + batchBytes);
+    std::vector<const char*> bounds{begin};
+    for (size_t i = 1; i < parts; i++) {
+        const char* cut = nextLine(begin + (batchEnd - begin) * i / parts);
+        if (cut > bounds.back() && cut < batchEnd)
+            bounds.push_back(cut);
+    }
+    bounds.push_back(batchEnd);
+    return bounds;
+}
+
+// Helper function to walk the binary rows of one batch, starting at begin,
+// and cut them into up to parts chunks of similar size
+inline std::vector<const char*> binaryBatchBounds(const char* begin, const char* end, size_t batchBytes, size_t parts,
+                                                  const std::string& path) {
+    size_t chunkBytes = std::max<size_t>(1, batchBytes / parts);
+    std::vector<const char*> bounds{begin};
+    const char* p = begin;
+    while (p < end && (size_t)(p - begin) < batchBytes) {
+        uint16_t len;
+        if (end - p < 10)
+            throw std::runtime_error(path + ": truncated row");
+        std::memcpy(&len, p + 8, 2);
+        if ((size_t)(end - p) < 10 + (size_t)len)
+            throw std::runtime_error(path + ": truncated row");
+        p += 10 + len;
+        if ((size_t)(p - bounds.back()) >= chunkBytes && p < end)
+            bounds.push_back(p);
+    }
+    if (bounds.back() != p)
+        bounds.push_back(p);
+    return bounds;
+}
+
+// Parse the rows of a CSV or binary file and bulk-load them into index in
+// batches. Throws std::system_error if the file cannot be read and
+// std::runtime_error on a truncated binary file.
+template<typename T>
+IngestReport ingestFile(T& index, const std::string& path, const IngestOptions& options = IngestOptions()) {
+    typedef typename T::RecordType RecordT;
+    typedef std::chrono::steady_clock Clock;
+
+    size_t threads = options.threads > 0 ? (size_t)options.threads : std::max(1u, std::thread::hardware_concurrency());
+    size_t batchBytes = std::max<size_t>(1, options.batchBytes);
+
+    MappedFile file(path);
+    const char* p = file.data();
+    const char* end = p + file.size();
+    IngestReport report;
+    report.bytes = file.size();
+    report.binary = file.size() >= 8 && std::memcmp(p, &INGEST_MAGIC, 8) == 0;
+    if (report.binary)
+        p += 8;
+
+    auto byId = [](const RecordT& a, const RecordT& b) { return a.id < b.id; };
+    while (p < end) {
+        Clock::time_point start = Clock::now();
+        std::vector<const char*> bounds = report.binary ? binaryBatchBounds(p, end, batchBytes, threads, path)
+                                                        : csvBatchBounds(p, end, batchBytes, threads);
+        size_t chunks = bounds.size() - 1;
+        std::vector<std::vector<RecordT>> runs(chunks);
+        std::vector<size_t> skipped(chunks);
+
+        // Parse and sort every chunk on its own thread
+        ingestParallel(chunks, [&](size_t c) {
+            if (report.binary)
+                parseBinaryChunk(bounds[c], bounds[c + 1], runs[c]);
+            else
+                parseCsvChunk(bounds[c], bounds[c + 1], runs[c], skipped[c]);
+            if (!std::is_sorted(runs[c].begin(), runs[c].end(), byId))
+                sortIngestRun(runs[c]);
+        });
+
+        // Merge neighbouring runs until one is left; the earlier run wins ties
+        while (runs.size() > 1) {
+            std::vector<std::vector<RecordT>> merged((runs.size() + 1) / 2);
+            ingestParallel(runs.size() / 2, [&](size_t i) {
+                std::vector<RecordT>& a = runs[2 * i];
+                std::vector<RecordT>& b = runs[2 * i + 1];
+                merged[i].reserve(a.size() + b.size());
+                std::merge(std::make_move_iterator(a.begin()), std::make_move_iterator(a.end()),
+                           std::make_move_iterator(b.begin()), std::make_move_iterator(b.end()),
+                           std::back_inserter(merged[i]), byId);
+                std::vector<RecordT>().swap(a);
+                std::vector<RecordT>().swap(b);
+            });
+            if (runs.size() % 2)
+                merged.back() = std::move(runs.back());
+            runs.swap(merged);
+        }
+        std::vector<RecordT>& batch = runs[0];
+        for (size_t s : skipped)
+            report.skipped += s;
+        report.rows += batch.size();
+        report.batches++;
+        p = bounds.back();
+
+        Clock::time_point parsed = Clock::now();
+        index.bulkLoad(std::make_move_iterator(batch.begin()), std::make_move_iterator(batch.end()));
+        Clock::time_point loaded = Clock::now();
+        report.parseSeconds += std::chrono::duration<double>(parsed - start).count();
+        report.loadSeconds += std::chrono::duration<double>(loaded - parsed).count();
+    }
+    return report;
+}
+
+// Write records as CSV rows, the format ingestFile() reads
+template<typename It>
+void writeCsvRecords(const std::string& path, It first, It last) {
+    int fd = ::open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0)
+        throw std::system_error(errno, std::generic_category(), "open " + path);
+    std::string buf;
+    for (; first != last; ++first) {
+        buf += std::to_string(first->id);
+        buf += ',';
+        buf += recordName(*first);
+        buf += ',';
+        buf += std::to_string((int)first->age);
+        buf += '\n';
+        if (buf.size() >= (1 << 20)) {
+            writeAll(fd, buf.data(), buf.size(), "write csv");
+            buf.clear();
+        }
+    }
+    writeAll(fd, buf.data(), buf.size(), "write csv");
+    ::close(fd);
+}
+
+// Write records in the binary format ingestFile() reads
+template<typename It>
+void writeBinaryRecords(const std::string& path, It first, It last) {
+    int fd = ::open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0)
+        throw std::system_error(errno, std::generic_category(), "open " + path);
+    std::vector<char> buf(reinterpret_cast<const char*>(&INGEST_MAGIC), reinterpret_cast<const char*>(&INGEST_MAGIC) + 8);
+    for (; first != last; ++first) {
+        encodeRecord(buf, *first);
+        if (buf.size() >= (1 << 20)) {
+            writeAll(fd, buf.data(), buf.size(), "write binary");
+            buf.clear();
+        }
+    }
+    writeAll(fd, buf.data(), buf.size(), "write binary");
+    ::close(fd);
+}
+
+#endif
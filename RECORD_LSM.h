@@ -0,0 +1,353 @@
+#ifndef RECORD_LSM_H
+#define RECORD_LSM_H
+
+#include <algorithm>
+#include <cstdint>
+#include <iostream>
+#include <utility>
+#include <vector>
+#include "RECORD.h"
+#include "BULK_LOAD.h"
+#include "NODE_ARENA.h"
+#include "RECORD_STATS.h"
+
+// Write-optimized index for insert-heavy ingest: an in-memory log-structured
+// merge tree keyed by id.
+//
+// Updates go to a memtable, an append-only buffer of up to bufferSize
+// messages (a record, or a tombstone for a remove) with a small
+// linear-probing table from id to message, so an update costs one hash probe
+// and an append instead of a root-to-leaf descent. When the buffer fills it
+// is sorted into an immutable run. Runs are kept newest first, each at least
+// LSM_MERGE_RATIO times larger than the one before it: a new run is merged into
+// its older neighbour until that holds again, so every record is rewritten
+// O(log(n / bufferSize)) times over its life, in sequential passes.
+// Tombstones are dropped once they reach the oldest run.
+//
+// A search checks the memtable and then the runs from newest to oldest,
+// stopping at the first message for the id, so it always sees the latest
+// update. Because of that, insert is an upsert: the latest record for an id
+// wins, where the trees keep the first one. Finding out whether an id is
+// already present would cost a read per write, which is what this index
+// avoids.
+//
+// Merges run synchronously on the inserting thread when a buffer is flushed,
+// so their cost is amortized over the buffer. Pointers returned by search()
+// are invalidated by the next update.
+
+const size_t LSM_DEFAULT_BUFFER = 4096;
+const size_t LSM_MERGE_RATIO = 4;
+
+template<typename RecordT>
+class BasicLSMIndex {
+public:
+    typedef RecordT RecordType;
+    typedef int KeyType;
+
+private:
+    // Immutable sorted run; live[i] == 0 marks a tombstone
+    struct Run {
+        std::vector<int> ids;
+        std::vector<RecordT> recs;
+        std::vector<uint8_t> live;
+
+        size_t size() const {
+            return ids.size();
+        }
+    };
+
+    size_t bufferSize;
+    std::vector<int> bufIds;             // memtable messages, in arrival order
+    std::vector<RecordT> bufRecs;
+    std::vector<uint8_t> bufLive;
+    std::vector<int> slotOf;             // memtable message of each hash slot, -1 if empty
+    size_t slotMask;
+    std::vector<Run> runs;               // newest first
+#ifdef RECORD_STATS
+    mutable IndexStats counters;
+#endif
+
+    // Helper function to mix an id into well-spread bits (murmur3 finalizer)
+    static uint64_t hashId(int id) {
+        uint64_t h = (uint64_t)(uint32_t)id;
+        h ^= h >> 33;
+        h *= 0xff51afd7ed558ccdULL;
+        h ^= h >> 33;
+        h *= 0xc4ceb9fe1a85ec53ULL;
+        h ^= h >> 33;
+        return h;
+    }
+
+    // Helper function to find id's hash slot: the one holding it, or the empty slot it would take
+    size_t probe(int id) const {
+        size_t h = hashId(id) & slotMask;
+        while (slotOf[h] >= 0 && bufIds[slotOf[h]] != id)
+            h = (h + 1) & slotMask;
+        return h;
+    }
+
+    // Helper function to find the first position in a run whose id is >= key;
+    // the halving step compiles to a conditional move instead of a branch
+    static size_t lowerBound(const Run& run, int key) {
+        const int* base = run.ids.data();
+        size_t len = run.size();
+        if (len == 0)
+            return 0;
+        while (len > 1) {
+            size_t half = len / 2;
+            base = base[half - 1] < key ? base + half : base;
+            len -= half;
+        }
+        return (size_t)(base - run.ids.data()) + (*base < key);
+    }
+
+    // Helper function to record the latest message for id in the memtable
+    template<typename R>
+    void put(int id, R&& rec, bool live) {
+        size_t h = probe(id);
+        if (slotOf[h] >= 0) {
+            bufRecs[slotOf[h]] = std::forward<R>(rec);
+            bufLive[slotOf[h]] = live;
+            return;
+        }
+        slotOf[h] = (int)bufIds.size();
+        bufIds.push_back(id);
+        bufRecs.push_back(std::forward<R>(rec));
+        bufLive.push_back(live);
+        if (bufIds.size() >= bufferSize)
+            flush();
+    }
+
+    // Helper function to merge two runs into one; newer wins on equal ids, and
+    // tombstones are dropped when the result becomes the oldest run
+    Run mergeRuns(Run& newer, Run& older, bool oldest) {
+        RECORD_STATS_ONLY(counters.merges++;)
+        Run out;
+        out.ids.reserve(newer.size() + older.size());
+        out.recs.reserve(newer.size() + older.size());
+        out.live.reserve(newer.size() + older.size());
+        auto emit = [&](Run& from, size_t i) {
+            if (oldest && !from.live[i])
+                return;
+            out.ids.push_back(from.ids[i]);
+            out.recs.push_back(std::move(from.recs[i]));
+            out.live.push_back(from.live[i]);
+        };
+        size_t i = 0, j = 0;
+        while (i < newer.size() && j < older.size()) {
+            if (newer.ids[i] < older.ids[j]) {
+                emit(newer, i++);
+            } else if (older.ids[j] < newer.ids[i]) {
+                emit(older, j++);
+            } else {
+                emit(newer, i++);
+                j++;
+            }
+        }
+        for (; i < newer.size(); i++)
+            emit(newer, i);
+        for (; j < older.size(); j++)
+            emit(older, j);
+        return out;
+    }
+
+    // Helper function to add a run as the newest and restore the size ratio between neighbours
+    void pushRun(Run run) {
+        runs.insert(runs.begin(), std::move(run));
+        while (runs.size() >= 2 && runs[0].size() * LSM_MERGE_RATIO > runs[1].size()) {
+            Run merged = mergeRuns(runs[0], runs[1], runs.size() == 2);
+            runs.erase(runs.begin());
+            runs[0] = std::move(merged);
+        }
+        if (runs.size() == 1)
+            dropTombstones(runs[0]);
+    }
+
+    // Helper function to compact away the tombstones of the oldest run
+    static void dropTombstones(Run& run) {
+        if (std::find(run.live.begin(), run.live.end(), 0) == run.live.end())
+            return;
+        size_t kept = 0;
+        for (size_t i = 0; i < run.size(); i++) {
+            if (!run.live[i])
+                continue;
+            run.ids[kept] = run.ids[i];
+            run.recs[kept] = std::move(run.recs[i]);
+            run.live[kept] = 1;
+            kept++;
+        }
+        run.ids.resize(kept);
+        run.recs.resize(kept);
+        run.live.resize(kept);
+    }
+
+    const RecordT* find(int id) const {
+        RECORD_STATS_ONLY(uint64_t before = counters.nodesVisited;)
+        const RecordT* result = nullptr;
+        int i = slotOf[probe(id)];
+        if (i >= 0) {
+            result = bufLive[i] ? &bufRecs[i] : nullptr;
+        } else {
+            for (const Run& run : runs) {
+                if (run.size() == 0 || id < run.ids.front() || run.ids.back() < id)
+                    continue;
+                RECORD_STATS_ONLY(counters.nodesVisited++;)
+                size_t pos = lowerBound(run, id);
+                if (pos < run.size() && run.ids[pos] == id) {
+                    result = run.live[pos] ? &run.recs[pos] : nullptr;
+                    break;
+                }
+            }
+        }
+        RECORD_STATS_ONLY(recordSearchVisits(counters, before);)
+        return result;
+    }
+
+public:
+    explicit BasicLSMIndex(size_t _bufferSize = LSM_DEFAULT_BUFFER)
+        : bufferSize(std::max<size_t>(1, _bufferSize)) {
+        size_t slots = 16;
+        while (slots < bufferSize * 2)
+            slots *= 2;
+        slotOf.assign(slots, -1);
+        slotMask = slots - 1;
+        bufIds.reserve(bufferSize);
+        bufRecs.reserve(bufferSize);
+        bufLive.reserve(bufferSize);
+    }
+
+    BasicLSMIndex(const BasicLSMIndex&) = delete;
+    BasicLSMIndex& operator=(const BasicLSMIndex&) = delete;
+
+    // Insert or replace the record with this id
+    void insert(const RecordT& rec) {
+        RECORD_STATS_ONLY(StatsTimer timer(counters.insertLatency);)
+        put(rec.id, rec, true);
+    }
+
+    void insert(RecordT&& rec) {
+        RECORD_STATS_ONLY(StatsTimer timer(counters.insertLatency);)
+        int id = rec.id;
+        put(id, std::move(rec), true);
+    }
+
+    // Construct the record from its constructor arguments and move it in
+    template<typename... Args>
+    void emplace(Args&&... args) {
+        insert(RecordT(std::forward<Args>(args)...));
+    }
+
+    void remove(int id) {
+        RECORD_STATS_ONLY(StatsTimer timer(counters.removeLatency);)
+        put(id, RecordT(), false);
+    }
+
+    // Add a batch as one run, newer than everything already stored. Within
+    // the batch the last record for an id wins, as with a sequence of insert()
+    template<typename It>
+    void bulkLoad(It first, It last) {
+        flush();
+        Run run;
+        run.recs = sortedLatestRecords<RecordT>(first, last);
+        run.ids.reserve(run.recs.size());
+        for (const RecordT& rec : run.recs)
+            run.ids.push_back(rec.id);
+        run.live.assign(run.recs.size(), 1);
+        if (run.size())
+            pushRun(std::move(run));
+    }
+
+    RecordT* search(int id) {
+        RECORD_STATS_ONLY(StatsTimer timer(counters.searchLatency);)
+        return const_cast<RecordT*>(find(id));
+    }
+
+    // Look up n ids at once, storing each record (or nullptr) in out
+    void searchBatch(const int* ids, size_t n, RecordT** out) {
+        for (size_t i = 0; i < n; i++)
+            out[i] = const_cast<RecordT*>(find(ids[i]));
+    }
+
+    // Sort the memtable into a run and merge as the size ratio requires
+    void flush() {
+        if (bufIds.empty())
+            return;
+        std::vector<int> order(bufIds.size());
+        for (size_t i = 0; i < order.size(); i++)
+            order[i] = (int)i;
+        std::sort(order.begin(), order.end(), [&](int a, int b) { return bufIds[a] < bufIds[b]; });
+
+        Run run;
+        run.ids.reserve(order.size());
+        run.recs.reserve(order.size());
+        run.live.reserve(order.size());
+        for (int i : order) {
+            run.ids.push_back(bufIds[i]);
+            run.recs.push_back(std::move(bufRecs[i]));
+            run.live.push_back(bufLive[i]);
+        }
+        bufIds.clear();
+        bufRecs.clear();
+        bufLive.clear();
+        std::fill(slotOf.begin(), slotOf.end(), -1);
+        pushRun(std::move(run));
+    }
+
+    // Flush and merge everything into a single run, the fastest layout for reads
+    void compact() {
+        flush();
+        while (runs.size() >= 2) {
+            Run merged = mergeRuns(runs[runs.size() - 2], runs.back(), true);
+            runs.pop_back();
+            runs.back() = std::move(merged);
+        }
+    }
+
+    size_t runCount() const {
+        return runs.size();
+    }
+
+    void print() {
+        compact();
+        if (!runs.empty()) {
+            for (const RecordT& rec : runs[0].recs)
+                std::cout << rec << std::endl;
+        }
+    }
+
+    // Runs and the memtable are plain arrays rather than an arena; report
+    // them in the same shape, with messages as nodes and tombstones as the
+    // free list
+    ArenaStats arenaStats() const {
+        ArenaStats s = ArenaStats();
+        s.chunks = runs.size() + 1;
+        s.reservedNodes = bufferSize;
+        s.liveNodes = bufIds.size();
+        for (const Run& run : runs) {
+            s.reservedNodes += run.size();
+            s.liveNodes += run.size();
+            s.freeListNodes += std::count(run.live.begin(), run.live.end(), 0);
+        }
+        s.nodeBytes = sizeof(int) + sizeof(RecordT) + 1;
+        s.reservedBytes = s.reservedNodes * s.nodeBytes + slotOf.size() * sizeof(int);
+        return s;
+    }
+
+    // Snapshot of the instrumentation counters; empty unless built with
+    // -DRECORD_STATS. nodesVisited counts runs searched, merges counts run merges.
+    IndexStats stats() const {
+#ifdef RECORD_STATS
+        return counters;
+#else
+        return IndexStats();
+#endif
+    }
+
+    void resetStats() {
+        RECORD_STATS_ONLY(counters = IndexStats();)
+    }
+};
+
+typedef BasicLSMIndex<Record> LSMIndex;
+
+#endif
@@ -0,0 +1,410 @@
+#ifndef RECORD_OLC_BTREE_H
+#define RECORD_OLC_BTREE_H
+
+#include <atomic>
+#include <cstdint>
+#include <thread>
+#include <type_traits>
+#include <vector>
+#include "RECORD.h"
+#include "NODE_SEARCH.h"
+
+// Thread-safe B+Tree using optimistic lock coupling.
+//
+// Every node carries a version word: bit 1 is the write latch, bit 0 marks a
+// node as obsolete, and the remaining bits count completed writes. Readers
+// never write shared memory: they note a node's version, read it, and
+// re-check the version before trusting what they read (restarting from the
+// root if it moved). Writers take the latch only on the nodes they change:
+// the leaf they insert into or remove from, or a full node and its parent
+// while splitting it. Full nodes are split on the way down, so a split
+// never has to propagate upwards.
+//
+// Because readers may see a node mid-update, records are copied out rather
+// than handed out by pointer, and must be trivially copyable (CompactRecord).
+// Removes do not merge nodes, so no node is freed while the tree is in use
+// and no memory reclamation scheme is needed.
+
+const int OLC_INNER_KEYS = 64;
+const int OLC_LEAF_RECORDS = 32;
+
+// Version word and latch shared by inner nodes and leaves
+class OLCNode {
+public:
+    std::atomic<uint64_t> version;
+    bool isLeaf;
+    int count;
+
+    OLCNode(bool _isLeaf) : version(0b100), isLeaf(_isLeaf), count(0) {}
+
+    static bool isLocked(uint64_t v) {
+        return (v & 0b10) == 0b10;
+    }
+
+    static bool isObsolete(uint64_t v) {
+        return (v & 1) == 1;
+    }
+
+    // Wait for any writer to finish and return the version to validate against
+    uint64_t readLockOrRestart(bool& needRestart) const {
+        uint64_t v = version.load();
+        while (isLocked(v)) {
+            std::this_thread::yield();
+            v = version.load();
+        }
+        if (isObsolete(v))
+            needRestart = true;
+        return v;
+    }
+
+    // Did anyone write the node since readLockOrRestart() returned startRead?
+    void readUnlockOrRestart(uint64_t startRead, bool& needRestart) const {
+        if (startRead != version.load())
+            needRestart = true;
+    }
+
+    void checkOrRestart(uint64_t startRead, bool& needRestart) const {
+        readUnlockOrRestart(startRead, needRestart);
+    }
+
+    // Turn a validated optimistic read into the write latch
+    void upgradeToWriteLockOrRestart(uint64_t& v, bool& needRestart) {
+        if (version.compare_exchange_strong(v, v + 0b10))
+            v = v + 0b10;
+        else
+            needRestart = true;
+    }
+
+    void writeUnlock() {
+        version.fetch_add(0b10);
+    }
+};
+
+class OLCInner : public OLCNode {
+public:
+    int keys[OLC_INNER_KEYS];                  // keys[i] <= every id in children[i + 1]
+    OLCNode* children[OLC_INNER_KEYS + 1];
+
+    OLCInner() : OLCNode(false) {}
+
+    bool isFull() const {
+        return count == OLC_INNER_KEYS;
+    }
+
+    // Insert separator key with child as its right neighbour; the node is latched and not full
+    void insert(int key, OLCNode* child) {
+        int pos = nodeUpperBound(keys, count, key);
+        for (int j = count; j > pos; j--) {
+            keys[j] = keys[j - 1];
+            children[j + 1] = children[j];
+        }
+        keys[pos] = key;
+        children[pos + 1] = child;
+        count++;
+    }
+
+    // Move the upper half into a new node, returning it and the separator between them
+    OLCInner* split(int& sep) {
+        OLCInner* right = new OLCInner();
+        int mid = count / 2;
+        sep = keys[mid];
+        right->count = count - mid - 1;
+        for (int j = 0; j < right->count; j++)
+            right->keys[j] = keys[mid + 1 + j];
+        for (int j = 0; j <= right->count; j++)
+            right->children[j] = children[mid + 1 + j];
+        count = mid;
+        return right;
+    }
+};
+
+template<typename RecordT>
+class BasicOLCLeaf : public OLCNode {
+public:
+    int ids[OLC_LEAF_RECORDS];
+    RecordT records[OLC_LEAF_RECORDS];
+
+    BasicOLCLeaf() : OLCNode(true) {}
+
+    bool isFull() const {
+        return count == OLC_LEAF_RECORDS;
+    }
+
+    // Insert a record into a latched leaf that is not full; returns false on a duplicate ID
+    bool insert(const RecordT& rec) {
+        int pos = nodeLowerBound(ids, count, rec.id);
+        if (pos < count && ids[pos] == rec.id)
+            return false;
+        for (int j = count; j > pos; j--) {
+            ids[j] = ids[j - 1];
+            records[j] = records[j - 1];
+        }
+        ids[pos] = rec.id;
+        records[pos] = rec;
+        count++;
+        return true;
+    }
+
+    bool remove(int id) {
+        int pos = nodeLowerBound(ids, count, id);
+        if (pos == count || ids[pos] != id)
+            return false;
+        for (int j = pos + 1; j < count; j++) {
+            ids[j - 1] = ids[j];
+            records[j - 1] = records[j];
+        }
+        count--;
+        return true;
+    }
+
+    BasicOLCLeaf* split(int& sep) {
+        BasicOLCLeaf* right = new BasicOLCLeaf();
+        int half = count / 2;
+        right->count = count - half;
+        for (int j = 0; j < right->count; j++) {
+            right->ids[j] = ids[half + j];
+            right->records[j] = records[half + j];
+        }
+        count = half;
+        sep = right->ids[0];
+        return right;
+    }
+};
+
+// OLCBTree class: concurrent insert/search/remove keyed by id
+template<typename RecordT>
+class BasicOLCBTree {
+private:
+    static_assert(std::is_trivially_copyable<RecordT>::value,
+                  "optimistic readers copy records that may be mid-update");
+
+    typedef BasicOLCLeaf<RecordT> OLCLeaf;
+
+    std::atomic<OLCNode*> root;
+
+    // Helper function to grow the tree by one level after the root split
+    void makeRoot(int sep, OLCNode* left, OLCNode* right) {
+        OLCInner* newRoot = new OLCInner();
+        newRoot->count = 1;
+        newRoot->keys[0] = sep;
+        newRoot->children[0] = left;
+        newRoot->children[1] = right;
+        root.store(newRoot);
+    }
+
+    // Helper function to latch a full node (and its parent) and split it.
+    // Does nothing if either changed since it was read; the caller restarts either way.
+    void splitNode(OLCNode* node, uint64_t versionNode, OLCInner* parent, uint64_t versionParent) {
+        bool needRestart = false;
+        if (parent) {
+            parent->upgradeToWriteLockOrRestart(versionParent, needRestart);
+            if (needRestart)
+                return;
+        }
+        node->upgradeToWriteLockOrRestart(versionNode, needRestart);
+        if (needRestart) {
+            if (parent)
+                parent->writeUnlock();
+            return;
+        }
+        if (!parent && node != root.load()) {
+            // Someone else grew a new root above this node
+            node->writeUnlock();
+            return;
+        }
+
+        int sep;
+        OLCNode* right;
+        if (node->isLeaf)
+            right = static_cast<OLCLeaf*>(node)->split(sep);
+        else
+            right = static_cast<OLCInner*>(node)->split(sep);
+
+        if (parent)
+            parent->insert(sep, right);
+        else
+            makeRoot(sep, node, right);
+
+        node->writeUnlock();
+        if (parent)
+            parent->writeUnlock();
+    }
+
+    // Helper function to free a subtree; only safe once no other thread uses the tree
+    void destroy(OLCNode* node) {
+        if (node->isLeaf) {
+            delete static_cast<OLCLeaf*>(node);
+            return;
+        }
+        OLCInner* inner = static_cast<OLCInner*>(node);
+        for (int j = 0; j <= inner->count; j++)
+            destroy(inner->children[j]);
+        delete inner;
+    }
+
+public:
+    BasicOLCBTree() : root(new OLCLeaf()) {}
+
+    ~BasicOLCBTree() {
+        destroy(root.load());
+    }
+
+    BasicOLCBTree(const BasicOLCBTree&) = delete;
+    BasicOLCBTree& operator=(const BasicOLCBTree&) = delete;
+
+    void insert(const RecordT& rec) {
+        int restartCount = 0;
+    restart:
+        if (restartCount++)
+            std::this_thread::yield();
+        bool needRestart = false;
+
+        OLCNode* node = root.load();
+        uint64_t versionNode = node->readLockOrRestart(needRestart);
+        if (needRestart || node != root.load())
+            goto restart;
+
+        OLCInner* parent = nullptr;
+        uint64_t versionParent = 0;
+
+        while (!node->isLeaf) {
+            OLCInner* inner = static_cast<OLCInner*>(node);
+
+            if (inner->isFull()) {
+                splitNode(inner, versionNode, parent, versionParent);
+                goto restart;
+            }
+
+            if (parent) {
+                parent->readUnlockOrRestart(versionParent, needRestart);
+                if (needRestart)
+                    goto restart;
+            }
+
+            parent = inner;
+            versionParent = versionNode;
+
+            node = inner->children[nodeUpperBound(inner->keys, inner->count, rec.id)];
+            inner->checkOrRestart(versionNode, needRestart);
+            if (needRestart)
+                goto restart;
+            versionNode = node->readLockOrRestart(needRestart);
+            if (needRestart)
+                goto restart;
+        }
+
+        OLCLeaf* leaf = static_cast<OLCLeaf*>(node);
+        if (leaf->isFull()) {
+            splitNode(leaf, versionNode, parent, versionParent);
+            goto restart;
+        }
+
+        leaf->upgradeToWriteLockOrRestart(versionNode, needRestart);
+        if (needRestart)
+            goto restart;
+        if (parent) {
+            parent->readUnlockOrRestart(versionParent, needRestart);
+            if (needRestart) {
+                leaf->writeUnlock();
+                goto restart;
+            }
+        }
+        leaf->insert(rec);
+        leaf->writeUnlock();
+    }
+
+    // Copy the record with the given id into out; returns false if absent
+    bool search(int ID, RecordT& out) const {
+        int restartCount = 0;
+    restart:
+        if (restartCount++)
+            std::this_thread::yield();
+        bool needRestart = false;
+
+        OLCNode* node = root.load();
+        uint64_t versionNode = node->readLockOrRestart(needRestart);
+        if (needRestart || node != root.load())
+            goto restart;
+
+        while (!node->isLeaf) {
+            OLCInner* inner = static_cast<OLCInner*>(node);
+            node = inner->children[nodeUpperBound(inner->keys, inner->count, ID)];
+            inner->checkOrRestart(versionNode, needRestart);
+            if (needRestart)
+                goto restart;
+            versionNode = node->readLockOrRestart(needRestart);
+            if (needRestart)
+                goto restart;
+        }
+
+        OLCLeaf* leaf = static_cast<OLCLeaf*>(node);
+        int pos = nodeLowerBound(leaf->ids, leaf->count, ID);
+        bool found = pos < leaf->count && leaf->ids[pos] == ID;
+        if (found)
+            out = leaf->records[pos];
+        leaf->readUnlockOrRestart(versionNode, needRestart);
+        if (needRestart)
+            goto restart;
+        return found;
+    }
+
+    bool contains(int ID) const {
+        RecordT rec;
+        return search(ID, rec);
+    }
+
+    void remove(int ID) {
+        int restartCount = 0;
+    restart:
+        if (restartCount++)
+            std::this_thread::yield();
+        bool needRestart = false;
+
+        OLCNode* node = root.load();
+        uint64_t versionNode = node->readLockOrRestart(needRestart);
+        if (needRestart || node != root.load())
+            goto restart;
+
+        OLCInner* parent = nullptr;
+        uint64_t versionParent = 0;
+
+        while (!node->isLeaf) {
+            OLCInner* inner = static_cast<OLCInner*>(node);
+
+            if (parent) {
+                parent->readUnlockOrRestart(versionParent, needRestart);
+                if (needRestart)
+                    goto restart;
+            }
+
+            parent = inner;
+            versionParent = versionNode;
+
+            node = inner->children[nodeUpperBound(inner->keys, inner->count, ID)];
+            inner->checkOrRestart(versionNode, needRestart);
+            if (needRestart)
+                goto restart;
+            versionNode = node->readLockOrRestart(needRestart);
+            if (needRestart)
+                goto restart;
+        }
+
+        OLCLeaf* leaf = static_cast<OLCLeaf*>(node);
+        leaf->upgradeToWriteLockOrRestart(versionNode, needRestart);
+        if (needRestart)
+            goto restart;
+        if (parent) {
+            parent->readUnlockOrRestart(versionParent, needRestart);
+            if (needRestart) {
+                leaf->writeUnlock();
+                goto restart;
+            }
+        }
+        leaf->remove(ID);
+        leaf->writeUnlock();
+    }
+};
+
+typedef BasicOLCBTree<CompactRecord> OLCBTree;
+
+#endif
@@ -0,0 +1,139 @@
+#ifndef RECORD_SECONDARY_H
+#define RECORD_SECONDARY_H
+
+#include <climits>
+#include <set>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+#include "RECORD.h"
+#include "BULK_LOAD.h"
+
+// A primary tree (any of BST, AVL, BTree, BPTree over Record or
+// CompactRecord) together with ordered secondary indexes on age and name.
+//
+// Each secondary index is an ordered set of (key, id) pairs, so equal keys
+// sort by id and every entry is unique. A predicate lookup is one descent to
+// the first matching pair followed by an in-order walk, O(log n + k) to
+// produce the k matching ids; each record is then fetched from the primary
+// tree by id, so a lookup costs O(log n + k log n) in all. The indexes hold
+// ids rather than record pointers because the trees move records between
+// nodes on splits, merges and deletions.
+//
+// All updates must go through this class to keep the indexes consistent,
+// which is why search() hands out const records.
+template<typename TreeT>
+class SecondaryIndexed {
+public:
+    typedef typename TreeT::RecordType RecordT;
+
+private:
+    TreeT primary;
+    std::set<std::pair<int, int>> byAge;
+    std::set<std::pair<std::string, int>> byName;
+
+    // Helper functions to read the indexed fields of either record layout
+    static int ageOf(const RecordT& rec) {
+        return (int)rec.age;
+    }
+
+    static std::string nameOf(const RecordT& rec) {
+        return std::string(rec.name);
+    }
+
+    // Helper function to add a record that is not in the primary tree yet
+    void indexRecord(const RecordT& rec) {
+        byAge.emplace(ageOf(rec), rec.id);
+        byName.emplace(nameOf(rec), rec.id);
+    }
+
+public:
+    // Arguments are forwarded to the primary tree's constructor (e.g. the BTree degree)
+    template<typename... Args>
+    explicit SecondaryIndexed(Args&&... args) : primary(std::forward<Args>(args)...) {}
+
+    SecondaryIndexed(const SecondaryIndexed&) = delete;
+    SecondaryIndexed& operator=(const SecondaryIndexed&) = delete;
+
+    // Insert a record; as with the trees, a duplicate id keeps the existing record
+    void insert(RecordT rec) {
+        if (primary.search(rec.id))
+            return;
+        indexRecord(rec);
+        primary.insert(std::move(rec));
+    }
+
+    void remove(int id) {
+        const RecordT* rec = primary.search(id);
+        if (!rec)
+            return;
+        byAge.erase({ageOf(*rec), id});
+        byName.erase({nameOf(*rec), id});
+        primary.remove(id);
+    }
+
+    // Bulk-load the primary tree and index the records it actually keeps
+    template<typename It>
+    void bulkLoad(It first, It last) {
+        std::vector<RecordT> recs = sortedUniqueRecords<RecordT>(first, last);
+        for (const RecordT& rec : recs) {
+            if (!primary.search(rec.id))
+                indexRecord(rec);
+        }
+        primary.bulkLoad(recs.begin(), recs.end());
+    }
+
+    const RecordT* search(int id) {
+        return primary.search(id);
+    }
+
+    // Call fn(const RecordT&) on every record with lo <= age <= hi, ordered
+    // by age and then id. Returns the number of records visited.
+    template<typename Fn>
+    size_t findByAge(int lo, int hi, Fn&& fn) {
+        size_t count = 0;
+        if (lo > hi)
+            return 0;
+        auto end = byAge.upper_bound({hi, INT_MAX});
+        for (auto it = byAge.lower_bound({lo, INT_MIN}); it != end; ++it, count++)
+            fn(*primary.search(it->second));
+        return count;
+    }
+
+    // Call fn(const RecordT&) on every record whose name starts with prefix,
+    // ordered by name and then id. Returns the number of records visited.
+    template<typename Fn>
+    size_t findByNamePrefix(std::string_view prefix, Fn&& fn) {
+        size_t count = 0;
+        for (auto it = byName.lower_bound({std::string(prefix), INT_MIN}); it != byName.end(); ++it, count++) {
+            if (it->first.compare(0, prefix.size(), prefix) != 0)
+                break;
+            fn(*primary.search(it->second));
+        }
+        return count;
+    }
+
+    // Call fn(const RecordT&) on every record with exactly this name. Like
+    // the lookups above, O(log n) per record visited, for the primary search.
+    template<typename Fn>
+    size_t findByName(std::string_view name, Fn&& fn) {
+        size_t count = 0;
+        std::string key(name);
+        auto end = byName.upper_bound({key, INT_MAX});
+        for (auto it = byName.lower_bound({key, INT_MIN}); it != end; ++it, count++)
+            fn(*primary.search(it->second));
+        return count;
+    }
+
+    // Read-only access to the primary tree for id-ordered queries
+    const TreeT& tree() const {
+        return primary;
+    }
+
+    size_t size() const {
+        return byAge.size();
+    }
+};
+
+#endif
@@ -0,0 +1,266 @@
+#ifndef RECORD_SKIPLIST_H
+#define RECORD_SKIPLIST_H
+
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <new>
+#include <thread>
+#include <utility>
+#include "RECORD.h"
+#include "EPOCH_RECLAIM.h"
+
+// Lock-free ordered index: a skip list in the style of Herlihy and Shavit,
+// keyed by Record::id.
+//
+// Every level is a sorted singly linked list and a node appears in the
+// lowest `height` of them. Links are changed only with compare-and-swap. The
+// low bit of a node's next pointer at a level marks the node itself as
+// deleted at that level; a node is logically removed once its level-0 link
+// is marked, and any thread that walks past a marked node unlinks it. Nodes
+// are never modified after they are published, so readers can copy records
+// out without synchronization, and unlinked nodes are freed through epoch-
+// based reclamation once no thread can still be reading them.
+//
+// The thread that marks a node and the thread that inserted it may still be
+// linking it into upper levels; whichever of the two finishes last does the
+// final unlink and retires the node, so it is retired exactly once and never
+// while still reachable.
+
+const int SKIPLIST_MAX_LEVEL = 16;    // With p = 1/4, enough for about 4^16 records
+
+template<typename RecordT>
+class BasicSkipList {
+private:
+    static const int INSERTED = 1;    // The inserting thread has stopped linking the node
+    static const int DELETED = 2;     // The node was logically removed
+
+    struct Node {
+        int id;
+        int height;
+        std::atomic<int> state;
+        RecordT rec;
+        std::atomic<uintptr_t> next[1];    // height entries, allocated past the end of the node
+
+        Node(const RecordT& _rec, int _height) : id(_rec.id), height(_height), state(0), rec(_rec) {}
+    };
+
+    Node* head;
+    mutable EpochDomain epochs;
+
+    static bool isMarked(uintptr_t link) {
+        return link & 1;
+    }
+
+    static Node* pointer(uintptr_t link) {
+        return reinterpret_cast<Node*>(link & ~(uintptr_t)1);
+    }
+
+    static uintptr_t linkTo(Node* node) {
+        return reinterpret_cast<uintptr_t>(node);
+    }
+
+    // Helper function to allocate a node with room for height links
+    static Node* createNode(const RecordT& rec, int height) {
+        size_t bytes = sizeof(Node) + (height - 1) * sizeof(std::atomic<uintptr_t>);
+        Node* node = new (::operator new(bytes)) Node(rec, height);
+        for (int i = 1; i < height; i++)
+            new (&node->next[i]) std::atomic<uintptr_t>(0);
+        node->next[0].store(0, std::memory_order_relaxed);
+        return node;
+    }
+
+    static void destroyNode(void* p) {
+        Node* node = static_cast<Node*>(p);
+        node->~Node();
+        ::operator delete(node);
+    }
+
+    // Helper function to draw a height: level i + 1 with probability 1/4 of level i
+    static int randomHeight() {
+        thread_local uint64_t state = std::hash<std::thread::id>()(std::this_thread::get_id()) | 1;
+        state ^= state << 13;
+        state ^= state >> 7;
+        state ^= state << 17;
+        int height = 1;
+        for (uint64_t bits = state; height < SKIPLIST_MAX_LEVEL && (bits & 3) == 0; bits >>= 2)
+            height++;
+        return height;
+    }
+
+    // Helper function to find, on every level, the last node with a smaller
+    // id (preds) and the node after it (succs), unlinking the marked nodes it
+    // passes. Returns true if succs[0] holds id.
+    bool find(int id, Node** preds, Node** succs) {
+    retry:
+        Node* pred = head;
+        for (int level = SKIPLIST_MAX_LEVEL - 1; level >= 0; level--) {
+            Node* curr = pointer(pred->next[level].load(std::memory_order_acquire));
+            while (curr != nullptr) {
+                uintptr_t succ = curr->next[level].load(std::memory_order_acquire);
+                while (isMarked(succ)) {
+                    uintptr_t expected = linkTo(curr);
+                    if (!pred->next[level].compare_exchange_strong(expected, succ & ~(uintptr_t)1, std::memory_order_acq_rel))
+                        goto retry;
+                    curr = pointer(succ);
+                    if (curr == nullptr)
+                        break;
+                    succ = curr->next[level].load(std::memory_order_acquire);
+                }
+                if (curr == nullptr || curr->id >= id)
+                    break;
+                pred = curr;
+                curr = pointer(succ);
+            }
+            preds[level] = pred;
+            succs[level] = curr;
+        }
+        return succs[0] != nullptr && succs[0]->id == id;
+    }
+
+    // Helper function run by whichever of the inserter and the remover
+    // finishes with a node last: unlink it from every level, then retire it
+    void finishNode(Node* node, int flag) {
+        if (node->state.fetch_or(flag, std::memory_order_acq_rel) == (INSERTED | DELETED) - flag) {
+            Node* preds[SKIPLIST_MAX_LEVEL];
+            Node* succs[SKIPLIST_MAX_LEVEL];
+            find(node->id, preds, succs);
+            epochs.retire(node, destroyNode);
+        }
+    }
+
+public:
+    BasicSkipList() {
+        head = createNode(RecordT(), SKIPLIST_MAX_LEVEL);
+    }
+
+    // Only safe once no other thread uses the list
+    ~BasicSkipList() {
+        Node* node = head;
+        while (node != nullptr) {
+            Node* next = pointer(node->next[0].load(std::memory_order_relaxed));
+            destroyNode(node);
+            node = next;
+        }
+    }
+
+    BasicSkipList(const BasicSkipList&) = delete;
+    BasicSkipList& operator=(const BasicSkipList&) = delete;
+
+    // Insert a record; a duplicate id keeps the existing record
+    void insert(const RecordT& rec) {
+        EpochDomain::Guard guard(epochs);
+        Node* preds[SKIPLIST_MAX_LEVEL];
+        Node* succs[SKIPLIST_MAX_LEVEL];
+        Node* node = nullptr;
+
+        // Publish the node by linking it into level 0
+        while (true) {
+            if (find(rec.id, preds, succs)) {
+                if (node)
+                    destroyNode(node);
+                return;
+            }
+            if (!node)
+                node = createNode(rec, randomHeight());
+            for (int i = 0; i < node->height; i++)
+                node->next[i].store(linkTo(succs[i]), std::memory_order_relaxed);
+            uintptr_t expected = linkTo(succs[0]);
+            if (preds[0]->next[0].compare_exchange_strong(expected, linkTo(node), std::memory_order_acq_rel))
+                break;
+        }
+
+        // Link the upper levels, giving up as soon as the node is removed
+        for (int level = 1; level < node->height; level++) {
+            while (true) {
+                if (isMarked(node->next[0].load(std::memory_order_acquire)))
+                    goto done;
+                uintptr_t expected = linkTo(succs[level]);
+                if (preds[level]->next[level].compare_exchange_strong(expected, linkTo(node), std::memory_order_acq_rel))
+                    break;
+                find(rec.id, preds, succs);
+                uintptr_t old = node->next[level].load(std::memory_order_acquire);
+                if (isMarked(old))
+                    goto done;
+                if (pointer(old) != succs[level] &&
+                    !node->next[level].compare_exchange_strong(old, linkTo(succs[level]), std::memory_order_acq_rel))
+                    goto done;
+            }
+        }
+    done:
+        finishNode(node, INSERTED);
+    }
+
+    // Copy the record with the given id into out; returns false if absent.
+    // Never writes shared memory.
+    bool search(int id, RecordT& out) const {
+        EpochDomain::Guard guard(epochs);
+        Node* pred = head;
+        Node* curr = nullptr;
+        for (int level = SKIPLIST_MAX_LEVEL - 1; level >= 0; level--) {
+            curr = pointer(pred->next[level].load(std::memory_order_acquire));
+            while (curr != nullptr) {
+                uintptr_t succ = curr->next[level].load(std::memory_order_acquire);
+                if (isMarked(succ)) {
+                    curr = pointer(succ);
+                } else if (curr->id < id) {
+                    pred = curr;
+                    curr = pointer(succ);
+                } else {
+                    break;
+                }
+            }
+        }
+        if (curr == nullptr || curr->id != id)
+            return false;
+        out = curr->rec;
+        return true;
+    }
+
+    bool contains(int id) const {
+        RecordT rec;
+        return search(id, rec);
+    }
+
+    void remove(int id) {
+        EpochDomain::Guard guard(epochs);
+        Node* preds[SKIPLIST_MAX_LEVEL];
+        Node* succs[SKIPLIST_MAX_LEVEL];
+        if (!find(id, preds, succs))
+            return;
+        Node* node = succs[0];
+
+        // Mark the upper levels top-down, then race for the level-0 mark
+        for (int level = node->height - 1; level >= 1; level--) {
+            uintptr_t link = node->next[level].load(std::memory_order_acquire);
+            while (!isMarked(link) &&
+                   !node->next[level].compare_exchange_weak(link, link | 1, std::memory_order_acq_rel)) {}
+        }
+        uintptr_t link = node->next[0].load(std::memory_order_acquire);
+        while (true) {
+            if (isMarked(link))
+                return;     // Another thread removed it first
+            if (node->next[0].compare_exchange_weak(link, link | 1, std::memory_order_acq_rel))
+                break;
+        }
+        finishNode(node, DELETED);
+    }
+
+    // Walk level 0 and count the records; exact only while no other thread
+    // modifies the list
+    size_t size() const {
+        EpochDomain::Guard guard(epochs);
+        size_t n = 0;
+        for (uintptr_t link = head->next[0].load(std::memory_order_acquire); pointer(link) != nullptr;) {
+            Node* node = pointer(link);
+            link = node->next[0].load(std::memory_order_acquire);
+            if (!isMarked(link))
+                n++;
+        }
+        return n;
+    }
+};
+
+typedef BasicSkipList<CompactRecord> SkipList;
+
+#endif
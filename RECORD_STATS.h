@@ -0,0 +1,143 @@
+#ifndef RECORD_STATS_H
+#define RECORD_STATS_H
+
+#include <chrono>
+#include <cstdint>
+
+// Optional instrumentation for the trees, compiled in with -DRECORD_STATS.
+//
+// When enabled, every tree keeps an IndexStats with structural counters
+// (nodes visited per search, rotations, splits, merges, borrows) and latency
+// histograms per operation type, and stats() returns a copy of it. When
+// disabled the trees hold no counters, the hooks below expand to nothing,
+// and stats() returns an empty snapshot.
+
+#ifdef RECORD_STATS
+inline constexpr bool RECORD_STATS_ENABLED = true;
+#define RECORD_STATS_ONLY(...) __VA_ARGS__
+#else
+inline constexpr bool RECORD_STATS_ENABLED = false;
+#define RECORD_STATS_ONLY(...)
+#endif
+
+// Log-linear histogram in the style of HdrHistogram. Values below 16 get a
+// bucket each and every power of two above that is split into 16 buckets,
+// so a reported value is within 1/16 of the value recorded.
+class StatsHistogram {
+public:
+    static const int SUB_BUCKETS = 16;
+    static const int OCTAVES = 40;                 // values up to 2^44
+    static const int BUCKETS = SUB_BUCKETS * (OCTAVES + 1);
+
+private:
+    uint64_t counts[BUCKETS] = {};
+    uint64_t total = 0;
+    uint64_t sum = 0;
+    uint64_t maxValue = 0;
+
+    static int bucketOf(uint64_t v) {
+        if (v < (uint64_t)SUB_BUCKETS)
+            return (int)v;
+        int shift = 63 - __builtin_clzll(v) - 4;
+        int b = SUB_BUCKETS + shift * SUB_BUCKETS + (int)((v >> shift) - SUB_BUCKETS);
+        return b < BUCKETS ? b : BUCKETS - 1;
+    }
+
+    // Highest value that lands in bucket b
+    static uint64_t bucketTop(int b) {
+        if (b < SUB_BUCKETS)
+            return (uint64_t)b;
+        int shift = (b - SUB_BUCKETS) / SUB_BUCKETS;
+        uint64_t sub = (uint64_t)((b - SUB_BUCKETS) % SUB_BUCKETS + SUB_BUCKETS);
+        return ((sub + 1) << shift) - 1;
+    }
+
+public:
+    void record(uint64_t v) {
+        counts[bucketOf(v)]++;
+        total++;
+        sum += v;
+        if (v > maxValue)
+            maxValue = v;
+    }
+
+    void merge(const StatsHistogram& other) {
+        for (int b = 0; b < BUCKETS; b++)
+            counts[b] += other.counts[b];
+        total += other.total;
+        sum += other.sum;
+        if (other.maxValue > maxValue)
+            maxValue = other.maxValue;
+    }
+
+    uint64_t count() const {
+        return total;
+    }
+
+    double mean() const {
+        return total ? (double)sum / total : 0;
+    }
+
+    uint64_t max() const {
+        return maxValue;
+    }
+
+    // Smallest bucket bound that covers a fraction q of the recorded values
+    uint64_t percentile(double q) const {
+        if (total == 0)
+            return 0;
+        uint64_t rank = (uint64_t)(q * total);
+        if (rank == 0)
+            rank = 1;
+        uint64_t seen = 0;
+        for (int b = 0; b < BUCKETS; b++) {
+            seen += counts[b];
+            if (seen >= rank)
+                return bucketTop(b) < maxValue ? bucketTop(b) : maxValue;
+        }
+        return maxValue;
+    }
+};
+
+// Snapshot returned by each tree's stats()
+struct IndexStats {
+    uint64_t searches = 0;
+    uint64_t nodesVisited = 0;         // Summed over all searches
+    uint64_t rotations = 0;            // AVL only; a double rotation counts as two
+    uint64_t splits = 0;               // BTree and B+Tree
+    uint64_t merges = 0;
+    uint64_t borrows = 0;
+    StatsHistogram searchVisits;       // Nodes visited per search
+    StatsHistogram searchLatency;      // Nanoseconds per operation
+    StatsHistogram insertLatency;
+    StatsHistogram removeLatency;
+
+    double meanNodesVisited() const {
+        return searches ? (double)nodesVisited / searches : 0;
+    }
+};
+
+#ifdef RECORD_STATS
+// Records the lifetime of the enclosing scope into a latency histogram
+class StatsTimer {
+private:
+    StatsHistogram& histogram;
+    std::chrono::steady_clock::time_point start;
+
+public:
+    explicit StatsTimer(StatsHistogram& h) : histogram(h), start(std::chrono::steady_clock::now()) {}
+
+    ~StatsTimer() {
+        auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start);
+        histogram.record((uint64_t)ns.count());
+    }
+};
+
+// Counts one search that brought stats.nodesVisited from `before` to its current value
+inline void recordSearchVisits(IndexStats& stats, uint64_t before) {
+    stats.searches++;
+    stats.searchVisits.record(stats.nodesVisited - before);
+}
+#endif
+
+#endif
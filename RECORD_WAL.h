@@ -0,0 +1,560 @@
+#ifndef RECORD_WAL_H
+#define RECORD_WAL_H
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <climits>
+#include <condition_variable>
+#include <cstdint>
+#include <cstring>
+#include <exception>
+#include <iostream>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <system_error>
+#include <thread>
+#include <utility>
+#include <vector>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#ifdef __SSE4_2__
+#include <nmmintrin.h>
+#endif
+#include "RECORD.h"
+
+// Write-ahead logging and crash recovery for the in-memory trees.
+//
+// DurableIndex wraps a tree and appends every insert and remove to a log
+// file before applying it. Each entry carries a sequence number (LSN) and a
+// CRC-32C of its contents. Appends are buffered and written with one
+// fdatasync per group (group commit): a group is flushed once it reaches
+// groupBytes, or by a background flusher thread once its first entry has
+// waited flushInterval, so a crash loses at most that window of mutations
+// even if no further mutation arrives. A zero interval syncs every mutation.
+//
+// A checkpoint writes the whole tree, in id order, to a snapshot file
+// stamped with the last LSN it contains, renames it into place and then
+// empties the log. Checkpoints run automatically once the log grows past
+// snapshotBytes, which bounds replay time. On open the snapshot is
+// bulk-loaded and the log entries with a higher LSN are replayed; a torn or
+// corrupt tail left by a crash is detected by its checksum and cut off.
+//
+// Files are path + ".wal" and path + ".snap", in native byte order.
+
+const uint64_t WAL_MAGIC = 0x31304C4157434552ULL;         // "RECWAL01"
+const uint64_t SNAPSHOT_MAGIC = 0x313050414E534552ULL;    // "RESNAP01"
+
+struct WalOptions {
+    size_t groupBytes = 64 * 1024;                              // buffered bytes that force a sync
+    std::chrono::microseconds flushInterval{10000};             // longest a mutation stays unsynced; 0 syncs each one
+    size_t snapshotBytes = 64 * 1024 * 1024;                    // log size that triggers a checkpoint; 0 never
+};
+
+// CRC-32C (Castagnoli), with the SSE4.2 instruction when the build allows it
+inline uint32_t crc32c(const void* data, size_t n, uint32_t crc = 0) {
+    const unsigned char* p = static_cast<const unsigned char*>(data);
+    crc = ~crc;
+#ifdef __SSE4_2__
+    for (; n >= 8; n -= 8, p += 8) {
+        uint64_t word;
+        std::memcpy(&word, p, 8);
+        crc = (uint32_t)_mm_crc32_u64(crc, word);
+    }
+    for (; n > 0; n--, p++)
+        crc = _mm_crc32_u8(crc, *p);
+#else
+    static const auto table = []() {
+        std::vector<uint32_t> t(256);
+        for (uint32_t i = 0; i < 256; i++) {
+            uint32_t c = i;
+            for (int k = 0; k < 8; k++)
+                c = (c >> 1) ^ (0x82F63B78u & (0u - (c & 1)));
+            t[i] = c;
+        }
+        return t;
+    }();
+    for (; n > 0; n--, p++)
+        crc = table[(crc ^ *p) & 0xFF] ^ (crc >> 8);
+#endif
+    return ~crc;
+}
+
+// Helper functions to read the name of either record layout
+inline std::string_view recordName(const Record& rec) {
+    return rec.name;
+}
+
+inline std::string_view recordName(const CompactRecord& rec) {
+    return std::string_view(rec.name);
+}
+
+// Record encoding shared by log entries and snapshots:
+// int32 id, int32 age, uint16 name length, name bytes
+template<typename RecordT>
+void encodeRecord(std::vector<char>& buf, const RecordT& rec) {
+    std::string_view name = recordName(rec);
+    int32_t id = rec.id, age = (int32_t)rec.age;
+    uint16_t len = (uint16_t)std::min<size_t>(name.size(), UINT16_MAX);
+    size_t at = buf.size();
+    buf.resize(at + 10 + len);
+    std::memcpy(&buf[at], &id, 4);
+    std::memcpy(&buf[at + 4], &age, 4);
+    std::memcpy(&buf[at + 8], &len, 2);
+    std::memcpy(&buf[at + 10], name.data(), len);
+}
+
+// Decode a record at p, within n bytes; returns the bytes consumed, 0 if truncated
+template<typename RecordT>
+size_t decodeRecord(const char* p, size_t n, RecordT& rec) {
+    int32_t id, age;
+    uint16_t len;
+    if (n < 10)
+        return 0;
+    std::memcpy(&id, p, 4);
+    std::memcpy(&age, p + 4, 4);
+    std::memcpy(&len, p + 8, 2);
+    if (n < 10 + (size_t)len)
+        return 0;
+    rec = RecordT(id, std::string(p + 10, len), age);
+    return 10 + len;
+}
+
+// Helper function to read a whole file; returns false if it does not exist
+inline bool readWholeFile(const std::string& path, std::vector<char>& out) {
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        if (errno == ENOENT)
+            return false;
+        throw std::system_error(errno, std::generic_category(), "open " + path);
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0) {
+        ::close(fd);
+        throw std::system_error(errno, std::generic_category(), "fstat " + path);
+    }
+    out.resize((size_t)st.st_size);
+    size_t done = 0;
+    while (done < out.size()) {
+        ssize_t r = ::read(fd, out.data() + done, out.size() - done);
+        if (r <= 0) {
+            int err = r < 0 ? errno : EIO;
+            ::close(fd);
+            throw std::system_error(err, std::generic_category(), "read " + path);
+        }
+        done += (size_t)r;
+    }
+    ::close(fd);
+    return true;
+}
+
+inline void writeAll(int fd, const char* data, size_t n, const char* what) {
+    while (n > 0) {
+        ssize_t w = ::write(fd, data, n);
+        if (w < 0) {
+            if (errno == EINTR)
+                continue;
+            throw std::system_error(errno, std::generic_category(), what);
+        }
+        data += w;
+        n -= (size_t)w;
+    }
+}
+
+// Helper function to make a rename in the directory of path durable
+inline void syncParentDir(const std::string& path) {
+    size_t slash = path.find_last_of('/');
+    std::string dir = slash == std::string::npos ? "." : slash == 0 ? "/" : path.substr(0, slash);
+    int fd = ::open(dir.c_str(), O_RDONLY | O_DIRECTORY);
+    if (fd < 0)
+        throw std::system_error(errno, std::generic_category(), "open " + dir);
+    int rc = fsync(fd);
+    int err = errno;
+    ::close(fd);
+    if (rc != 0)
+        throw std::system_error(err, std::generic_category(), "fsync " + dir);
+}
+
+// Append-only log of mutations with group commit.
+//
+// Entry: uint32 crc, uint32 payload size, uint64 lsn, uint8 type, payload.
+// The crc covers everything after itself. The file starts with WAL_MAGIC.
+//
+// With a non-zero flushInterval, open() starts a flusher thread that syncs a
+// buffered group when its interval runs out. The buffer is shared with it
+// under a mutex; an error on that thread is rethrown by the next append or
+// sync.
+class WriteAheadLog {
+public:
+    enum EntryType : uint8_t { Insert = 1, Remove = 2 };
+    static const size_t HEADER_BYTES = 17;
+
+private:
+    std::string path;
+    int fd;
+    WalOptions options;
+    std::vector<char> buffer;            // appended entries not yet written
+    uint64_t fileBytes;                  // bytes in the file, including the magic
+    uint64_t syncs;
+    std::chrono::steady_clock::time_point pendingSince;   // when the oldest buffered entry was appended
+    mutable std::mutex mutex;            // guards everything above against the flusher
+    std::condition_variable wake;
+    std::thread flusher;
+    bool stopping;
+    std::exception_ptr failure;          // error hit by the flusher, not yet reported
+
+    // Helper function to write and fdatasync the buffer; the mutex is held
+    void flush() {
+        if (buffer.empty())
+            return;
+        writeAll(fd, buffer.data(), buffer.size(), "write wal");
+        fileBytes += buffer.size();
+        buffer.clear();
+        if (fdatasync(fd) != 0)
+            throw std::system_error(errno, std::generic_category(), "fdatasync " + path);
+        syncs++;
+    }
+
+    // Helper function to report an error hit by the flusher; the mutex is held
+    void rethrowFailure() {
+        if (failure)
+            std::rethrow_exception(std::exchange(failure, nullptr));
+    }
+
+    // Body of the flusher thread: sleep until the oldest buffered entry is
+    // due, then sync the group it belongs to
+    void flushLoop() {
+        std::unique_lock<std::mutex> lock(mutex);
+        while (!stopping) {
+            if (buffer.empty() || failure) {
+                wake.wait(lock);
+                continue;
+            }
+            auto due = pendingSince + options.flushInterval;
+            if (std::chrono::steady_clock::now() < due) {
+                wake.wait_until(lock, due);
+                continue;
+            }
+            try {
+                flush();
+            } catch (...) {
+                failure = std::current_exception();
+            }
+        }
+    }
+
+public:
+    WriteAheadLog(std::string _path, const WalOptions& _options)
+        : path(std::move(_path)), fd(-1), options(_options), fileBytes(0), syncs(0), stopping(false) {}
+
+    ~WriteAheadLog() {
+        if (flusher.joinable()) {
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                stopping = true;
+            }
+            wake.notify_one();
+            flusher.join();
+        }
+        if (fd >= 0) {
+            try {
+                flush();
+            } catch (const std::exception& e) {
+                std::cerr << "WriteAheadLog: " << e.what() << std::endl;
+            }
+            ::close(fd);
+        }
+    }
+
+    WriteAheadLog(const WriteAheadLog&) = delete;
+    WriteAheadLog& operator=(const WriteAheadLog&) = delete;
+
+    // Call fn(type, lsn, payload, size) for every intact entry in the log,
+    // then open it for appending after the last one, cutting off a torn
+    // tail. Returns the highest LSN seen, or 0.
+    template<typename Fn>
+    uint64_t open(Fn&& fn) {
+        std::vector<char> data;
+        bool exists = readWholeFile(path, data);
+        uint64_t lastLsn = 0;
+        size_t good = 0;
+        if (exists && data.size() >= 8) {
+            uint64_t magic;
+            std::memcpy(&magic, data.data(), 8);
+            if (magic != WAL_MAGIC)
+                throw std::runtime_error(path + ": not a write-ahead log");
+            good = 8;
+            while (data.size() - good >= HEADER_BYTES) {
+                const char* p = data.data() + good;
+                uint32_t crc, size;
+                uint64_t lsn;
+                std::memcpy(&crc, p, 4);
+                std::memcpy(&size, p + 4, 4);
+                std::memcpy(&lsn, p + 8, 8);
+                if (size > data.size() - good - HEADER_BYTES || crc32c(p + 4, HEADER_BYTES - 4 + size) != crc)
+                    break;
+                fn((EntryType)p[16], lsn, p + HEADER_BYTES, (size_t)size);
+                lastLsn = lsn;
+                good += HEADER_BYTES + size;
+            }
+        }
+
+        fd = ::open(path.c_str(), O_WRONLY | O_CREAT, 0644);
+        if (fd < 0)
+            throw std::system_error(errno, std::generic_category(), "open " + path);
+        if (good == 0) {
+            reset();
+        } else {
+            if (good < data.size() && ftruncate(fd, (off_t)good) != 0)
+                throw std::system_error(errno, std::generic_category(), "ftruncate " + path);
+            if (lseek(fd, (off_t)good, SEEK_SET) < 0)
+                throw std::system_error(errno, std::generic_category(), "lseek " + path);
+            fileBytes = good;
+        }
+        if (options.flushInterval.count() > 0)
+            flusher = std::thread(&WriteAheadLog::flushLoop, this);
+        return lastLsn;
+    }
+
+    // Append an entry; the caller fills payload bytes through encode(buffer)
+    template<typename Encode>
+    void append(EntryType type, uint64_t lsn, Encode&& encode) {
+        std::lock_guard<std::mutex> lock(mutex);
+        rethrowFailure();
+        size_t at = buffer.size();
+        buffer.resize(at + HEADER_BYTES);
+        encode(buffer);
+        uint32_t size = (uint32_t)(buffer.size() - at - HEADER_BYTES);
+        std::memcpy(&buffer[at + 4], &size, 4);
+        std::memcpy(&buffer[at + 8], &lsn, 8);
+        buffer[at + 16] = (char)type;
+        uint32_t crc = crc32c(&buffer[at + 4], HEADER_BYTES - 4 + size);
+        std::memcpy(&buffer[at], &crc, 4);
+
+        if (buffer.size() >= options.groupBytes || options.flushInterval.count() == 0) {
+            flush();
+        } else if (at == 0) {
+            // First entry of a group: the flusher syncs it once the interval runs out
+            pendingSince = std::chrono::steady_clock::now();
+            wake.notify_one();
+        }
+    }
+
+    // Write and fdatasync everything appended so far
+    void sync() {
+        std::lock_guard<std::mutex> lock(mutex);
+        rethrowFailure();
+        flush();
+    }
+
+    // Empty the log, keeping only the magic
+    void reset() {
+        std::lock_guard<std::mutex> lock(mutex);
+        buffer.clear();
+        if (ftruncate(fd, 0) != 0)
+            throw std::system_error(errno, std::generic_category(), "ftruncate " + path);
+        if (lseek(fd, 0, SEEK_SET) < 0)
+            throw std::system_error(errno, std::generic_category(), "lseek " + path);
+        writeAll(fd, reinterpret_cast<const char*>(&WAL_MAGIC), 8, "write wal");
+        if (fdatasync(fd) != 0)
+            throw std::system_error(errno, std::generic_category(), "fdatasync " + path);
+        fileBytes = 8;
+    }
+
+    // Log size including entries still buffered
+    uint64_t bytes() const {
+        std::lock_guard<std::mutex> lock(mutex);
+        return fileBytes + buffer.size();
+    }
+
+    uint64_t syncCount() const {
+        std::lock_guard<std::mutex> lock(mutex);
+        return syncs;
+    }
+};
+
+// A tree (BST, AVL, BTree or BPTree keyed by id) whose mutations are logged
+// before they are applied. Searches go straight to the tree.
+template<typename TreeT>
+class DurableIndex {
+public:
+    typedef typename TreeT::RecordType RecordType;
+    typedef int KeyType;
+
+private:
+    typedef RecordType RecordT;
+
+    TreeT primary;
+    std::string snapshotPath;
+    WriteAheadLog log;
+    WalOptions options;
+    uint64_t lsn;                        // LSN of the last logged mutation
+    size_t replayed;                     // log entries applied while opening
+
+    // Helper function to load the snapshot into the tree; returns its LSN, or 0 if there is none
+    uint64_t loadSnapshot() {
+        std::vector<char> data;
+        if (!readWholeFile(snapshotPath, data))
+            return 0;
+        uint64_t magic, snapLsn, count;
+        uint32_t crc;
+        if (data.size() < 28)
+            throw std::runtime_error(snapshotPath + ": truncated snapshot");
+        std::memcpy(&magic, data.data(), 8);
+        std::memcpy(&snapLsn, data.data() + 8, 8);
+        std::memcpy(&count, data.data() + 16, 8);
+        std::memcpy(&crc, data.data() + data.size() - 4, 4);
+        if (magic != SNAPSHOT_MAGIC)
+            throw std::runtime_error(snapshotPath + ": not a snapshot");
+        if (crc32c(data.data(), data.size() - 4) != crc)
+            throw std::runtime_error(snapshotPath + ": checksum mismatch");
+
+        std::vector<RecordT> recs;
+        recs.reserve(count);
+        size_t at = 24, end = data.size() - 4;
+        for (uint64_t i = 0; i < count; i++) {
+            RecordT rec;
+            size_t used = decodeRecord(data.data() + at, end - at, rec);
+            if (used == 0)
+                throw std::runtime_error(snapshotPath + ": truncated snapshot");
+            recs.push_back(std::move(rec));
+            at += used;
+        }
+        primary.bulkLoad(recs.begin(), recs.end());
+        return snapLsn;
+    }
+
+    // Helper function to apply one log entry during recovery
+    void replay(WriteAheadLog::EntryType type, const char* payload, size_t size) {
+        if (type == WriteAheadLog::Insert) {
+            RecordT rec;
+            if (decodeRecord(payload, size, rec))
+                primary.insert(std::move(rec));
+        } else if (type == WriteAheadLog::Remove && size >= 4) {
+            int32_t id;
+            std::memcpy(&id, payload, 4);
+            primary.remove(id);
+        }
+    }
+
+    void maybeCheckpoint() {
+        if (options.snapshotBytes && log.bytes() >= options.snapshotBytes)
+            checkpoint();
+    }
+
+public:
+    // Recover the index stored at path (or start an empty one). Trailing
+    // arguments are forwarded to the tree's constructor (e.g. the BTree degree).
+    template<typename... Args>
+    DurableIndex(const std::string& path, const WalOptions& _options, Args&&... args)
+        : primary(std::forward<Args>(args)...), snapshotPath(path + ".snap"), log(path + ".wal", _options),
+          options(_options), lsn(0), replayed(0) {
+        uint64_t snapLsn = loadSnapshot();
+        lsn = snapLsn;
+        uint64_t logLsn = log.open([&](WriteAheadLog::EntryType type, uint64_t entryLsn, const char* payload, size_t size) {
+            // entries already in the snapshot survive a crash between its rename and the log reset
+            if (entryLsn <= snapLsn)
+                return;
+            replay(type, payload, size);
+            replayed++;
+        });
+        lsn = std::max(lsn, logLsn);
+    }
+
+    DurableIndex(const DurableIndex&) = delete;
+    DurableIndex& operator=(const DurableIndex&) = delete;
+
+    void insert(const RecordT& rec) {
+        log.append(WriteAheadLog::Insert, ++lsn, [&](std::vector<char>& buf) { encodeRecord(buf, rec); });
+        primary.insert(rec);
+        maybeCheckpoint();
+    }
+
+    void insert(RecordT&& rec) {
+        log.append(WriteAheadLog::Insert, ++lsn, [&](std::vector<char>& buf) { encodeRecord(buf, rec); });
+        primary.insert(std::move(rec));
+        maybeCheckpoint();
+    }
+
+    void remove(int id) {
+        log.append(WriteAheadLog::Remove, ++lsn, [&](std::vector<char>& buf) {
+            int32_t key = id;
+            buf.insert(buf.end(), reinterpret_cast<const char*>(&key), reinterpret_cast<const char*>(&key) + 4);
+        });
+        primary.remove(id);
+        maybeCheckpoint();
+    }
+
+    const RecordT* search(int id) {
+        return primary.search(id);
+    }
+
+    // Bulk-load the tree and make the result durable with a checkpoint
+    template<typename It>
+    void bulkLoad(It first, It last) {
+        primary.bulkLoad(first, last);
+        checkpoint();
+    }
+
+    // Make every logged mutation durable
+    void sync() {
+        log.sync();
+    }
+
+    // Write a snapshot of the tree and empty the log
+    void checkpoint() {
+        log.sync();
+        std::vector<char> buf(24);
+        uint64_t count = 0;
+        primary.rangeScan(INT_MIN, INT_MAX, [&](const RecordT& rec) {
+            encodeRecord(buf, rec);
+            count++;
+        });
+        std::memcpy(&buf[0], &SNAPSHOT_MAGIC, 8);
+        std::memcpy(&buf[8], &lsn, 8);
+        std::memcpy(&buf[16], &count, 8);
+        uint32_t crc = crc32c(buf.data(), buf.size());
+        buf.insert(buf.end(), reinterpret_cast<const char*>(&crc), reinterpret_cast<const char*>(&crc) + 4);
+
+        std::string tmp = snapshotPath + ".tmp";
+        int fd = ::open(tmp.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        if (fd < 0)
+            throw std::system_error(errno, std::generic_category(), "open " + tmp);
+        try {
+            writeAll(fd, buf.data(), buf.size(), "write snapshot");
+            if (fsync(fd) != 0)
+                throw std::system_error(errno, std::generic_category(), "fsync " + tmp);
+        } catch (...) {
+            ::close(fd);
+            throw;
+        }
+        ::close(fd);
+        if (rename(tmp.c_str(), snapshotPath.c_str()) != 0)
+            throw std::system_error(errno, std::generic_category(), "rename " + tmp);
+        syncParentDir(snapshotPath);
+        log.reset();
+    }
+
+    // Read-only access to the tree for ordered queries
+    const TreeT& tree() const {
+        return primary;
+    }
+
+    // Log entries replayed on open, past the snapshot
+    size_t replayedEntries() const {
+        return replayed;
+    }
+
+    uint64_t logBytes() const {
+        return log.bytes();
+    }
+
+    uint64_t syncCount() const {
+        return log.syncCount();
+    }
+};
+
+#endif
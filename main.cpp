@@ -1,156 +1,997 @@
 #include<iostream>
-#include<chrono>
+#include<fstream>
 #include<vector>
+#include<string>
+#include<sstream>
+#include<functional>
+#include<mutex>
+#include<thread>
+#include<type_traits>
+#include<climits>
 #include<cstdlib>
-#include<ctime>
-#include<iomanip>
+#include<unistd.h>
 #include "RECORD_AVL.h"
 #include "RECORD_BST.h"
 #include "RECORD_BTREE.h"
+#include "RECORD_BPTREE.h"
+#include "RECORD_HASH.h"
+#include "RECORD_LSM.h"
+#include "RECORD_OLC_BTREE.h"
+#include "RECORD_SKIPLIST.h"
+#include "RECORD_DISK_BTREE.h"
+#include "RECORD_WAL.h"
+#include "RECORD_INGEST.h"
+#include "RECORD_SECONDARY.h"
+#include "BENCHMARK.h"
 
+using namespace std;
 
 
-#define int long long int
+struct BenchmarkOptions {
+    WorkloadConfig workload;
+    int repetitions = 3;
+    string format = "table";
+    string layout = "record";
+    vector<string> structures = {"avl", "bst", "btree", "btree64", "bptree", "hash", "lsm", "olc", "skiplist", "disk", "wal", "ingest", "secondary"};
+    int btreeDegree = 3;
+    int maxThreads = (int)max(1u, thread::hardware_concurrency());
+    string mode = "serial";
+};
+
+
+void printUsage(const char* prog){
+    cout << "usage: " << prog << " [options]\n"
+         << "  --records N        records preloaded before the mixed phase (1000000)\n"
+         << "  --ops N            operations in the mixed phase (1000000)\n"
+         << "  --dist D           key distribution: uniform, zipf, sorted, reverse (uniform)\n"
+         << "  --theta T          zipf skew in (0, 1) (0.99)\n"
+         << "  --hit R            fraction of searches that target a preloaded id (0.9)\n"
+         << "  --read P           percent of operations that search (90)\n"
+         << "  --insert P         percent of operations that insert; the rest remove (5)\n"
+         << "  --seed S           workload seed (42)\n"
+         << "  --reps N           repetitions of every phase (3)\n"
+         << "  --format F         table, csv or json (table)\n"
+         << "  --layout L         record or compact (record)\n"
+         << "  --structures LIST  comma-separated subset of avl,bst,btree,btree64,bptree,hash,lsm,olc,skiplist,disk,wal,ingest,secondary\n"
+         << "  --degree N         BTree degree (3)\n"
+         << "  --threads N        highest thread count for the concurrent and sharded benchmarks (cores)\n"
+         << "  --mode M           serial, or sharded: one pinned thread per index instance (serial)\n";
+}
 
-using namespace std;
-using namespace std::chrono;
 
-string getRandomName(){
-    string s = "";
-    s.push_back((char)('A' + rand()%26));
-    s.push_back((char)('A' + rand()%26));
-    s.push_back((char)('A' + rand()%26));
-    s.push_back((char)('A' + rand()%26));
-    return s;
+BenchmarkOptions parseOptions(int argc, char** argv){
+    BenchmarkOptions opt;
+    for(int i=1;i<argc;i++){
+        string arg = argv[i];
+        if(arg == "--help" || arg == "-h"){
+            printUsage(argv[0]);
+            exit(0);
+        }
+        if(i + 1 >= argc){
+            throw invalid_argument("missing value for " + arg);
+        }
+        string value = argv[++i];
+
+        if(arg == "--records") opt.workload.records = stoul(value);
+        else if(arg == "--ops") opt.workload.operations = stoul(value);
+        else if(arg == "--dist") opt.workload.distribution = parseDistribution(value);
+        else if(arg == "--theta") opt.workload.zipfTheta = stod(value);
+        else if(arg == "--hit") opt.workload.hitRatio = stod(value);
+        else if(arg == "--read") opt.workload.readPercent = stoi(value);
+        else if(arg == "--insert") opt.workload.insertPercent = stoi(value);
+        else if(arg == "--seed") opt.workload.seed = stoull(value);
+        else if(arg == "--reps") opt.repetitions = max(1, stoi(value));
+        else if(arg == "--format") opt.format = value;
+        else if(arg == "--layout") opt.layout = value;
+        else if(arg == "--degree") opt.btreeDegree = stoi(value);
+        else if(arg == "--threads") opt.maxThreads = max(1, stoi(value));
+        else if(arg == "--mode") opt.mode = value;
+        else if(arg == "--structures"){
+            opt.structures.clear();
+            stringstream ss(value);
+            string name;
+            while(getline(ss, name, ',')){
+                opt.structures.push_back(name);
+            }
+        }
+        else throw invalid_argument("unknown option " + arg);
+    }
+    if(opt.format != "table" && opt.format != "csv" && opt.format != "json"){
+        throw invalid_argument("unknown format " + opt.format);
+    }
+    if(opt.layout != "record" && opt.layout != "compact"){
+        throw invalid_argument("unknown layout " + opt.layout);
+    }
+    if(opt.mode != "serial" && opt.mode != "sharded"){
+        throw invalid_argument("unknown mode " + opt.mode);
+    }
+    return opt;
 }
 
-Record getDummyRecord(){
-    Record rec;
-    int id = rand() % 50001;
-    int age = rand() % 100;
-    string name = getRandomName();
-
-    rec.id = id;
-    rec.age = age;
-    rec.name = name;
 
-    return rec;
+bool selected(const BenchmarkOptions& opt, const string& name){
+    return find(opt.structures.begin(), opt.structures.end(), name) != opt.structures.end();
 }
 
-int getRandomID(){
-    return rand()%5001;
+
+// Apply one operation of the mixed stream. Inserts move their record out of
+// the per-repetition copy of the workload's insert records.
+template<typename T, typename RecordT>
+void applyOperation(T *table, const Operation& op, vector<RecordT>& inserts){
+    switch(op.type){
+        case OpType::Search:
+            benchmarkSink = (size_t)table->search(op.id);
+            break;
+        case OpType::Insert:
+            table->insert(std::move(inserts[op.record]));
+            break;
+        case OpType::Remove:
+            table->remove(op.id);
+            break;
+    }
 }
 
 
+// Ordered indexes get the range-scan phase; the hash index does not
+template<typename T, typename = void>
+struct hasRangeScan : std::false_type {};
+
+template<typename T>
+struct hasRangeScan<T, std::void_t<decltype(std::declval<const T&>().first())>> : std::true_type {};
+
+// Trees with subtree counts (AVL and BTree) also get the order-statistic phases
+template<typename T, typename = void>
+struct hasOrderStatistics : std::false_type {};
+
+template<typename T>
+struct hasOrderStatistics<T, std::void_t<decltype(std::declval<const T&>().countRange(0, 0))>> : std::true_type {};
+
+// Trees that can be frozen into a read-only Eytzinger index (BST, AVL, BTree)
+template<typename T, typename = void>
+struct hasFreeze : std::false_type {};
+
+template<typename T>
+struct hasFreeze<T, std::void_t<decltype(std::declval<const T&>().freeze())>> : std::true_type {};
+
+// Trees with join-based set operations (AVL)
+template<typename T, typename = void>
+struct hasSetOperations : std::false_type {};
+
+template<typename T>
+struct hasSetOperations<T, std::void_t<decltype(std::declval<T&>().unionWith(std::declval<T&>()))>> : std::true_type {};
+
+// Trees that can defer removes and compact later (BTree)
+template<typename T, typename = void>
+struct hasLazyRemove : std::false_type {};
+
 template<typename T>
-double insertionTime(T *&table, int record_size){
-    auto start = high_resolution_clock::now();
+struct hasLazyRemove<T, std::void_t<decltype(std::declval<const T&>().lazyRemove())>> : std::true_type {};
+
+// Width of the id window of each count-range query; preloaded ids are even,
+// so a window covers about half as many records
+const int COUNT_RANGE_SPAN = 1000;
+
+
+// Load, mixed, batch search, bulk load and remove phases for one
+// single-threaded index, plus range scan, frozen search, set operations,
+// count-range, select and compaction where supported
+template<typename T, typename RecordT>
+void benchmarkTree(const string& name, function<T*()> makeTable, const Workload<RecordT>& w,
+                   const BenchmarkOptions& opt, vector<BenchmarkResult>& results,
+                   vector<pair<string, ArenaStats>>& arenas, vector<pair<string, IndexStats>>& stats){
+    static_assert(isPointIndex<T>, "benchmarkTree needs insert, search and remove");
+    string layout = opt.layout;
+    string dist = distributionName(opt.workload.distribution);
+    RepetitionStats load_reps, mixed_reps, batch_reps, bulk_reps, scan_reps, count_reps, select_reps;
+    RepetitionStats search_reps, freeze_reps, frozen_reps, frozen_batch_reps;
+    RepetitionStats reinsert_reps, union_reps, difference_reps, remove_reps, compact_reps;
+    bool lazy = false;
+    LatencyRecorder load_latency, mixed_latency, remove_latency;
+
+    for(int rep=0;rep<opt.repetitions;rep++){
+        // copies are made outside the timed regions, since inserts consume them
+        vector<RecordT> load = w.load;
+        vector<RecordT> inserts = w.inserts;
+        vector<RecordT*> found(w.searchIds.size());
+
+        T *table = makeTable();
+
+        double ns = timeEach(load.size(), load_latency, [&](size_t i){
+            table->insert(std::move(load[i]));
+        });
+        load_reps.add(ns, load.size());
+
+        ns = timeEach(w.ops.size(), mixed_latency, [&](size_t i){
+            applyOperation(table, w.ops[i], inserts);
+        });
+        mixed_reps.add(ns, w.ops.size());
+
+        ns = timeOnce([&](){
+            table->searchBatch(w.searchIds.data(), w.searchIds.size(), found.data());
+        });
+        batch_reps.add(ns, w.searchIds.size());
+
+        if(rep == opt.repetitions - 1){
+            arenas.push_back({name, table->arenaStats()});
+            stats.push_back({name, table->stats()});
+        }
+        delete table;
+
+        T *rebuilt = makeTable();
+        ns = timeOnce([&](){
+            rebuilt->bulkLoad(w.load.begin(), w.load.end());
+        });
+        bulk_reps.add(ns, w.load.size());
+
+        if constexpr (hasRangeScan<T>::value){
+            // one ordered sweep over every id, streamed through rangeScan
+            size_t scanned = 0;
+            ns = timeOnce([&](){
+                scanned = rebuilt->rangeScan(INT_MIN, INT_MAX, [](const RecordT& rec){
+                    benchmarkSink += rec.id;
+                });
+            });
+            scan_reps.add(ns, scanned);
+        }
+
+        if constexpr (hasFreeze<T>::value){
+            // point lookups on the tree against the same lookups on its frozen copy
+            ns = timeOnce([&](){
+                for(int id : w.searchIds)
+                    benchmarkSink = (size_t)rebuilt->search(id);
+            });
+            search_reps.add(ns, w.searchIds.size());
+
+            decltype(rebuilt->freeze()) frozen;
+            ns = timeOnce([&](){
+                frozen = rebuilt->freeze();
+            });
+            freeze_reps.add(ns, w.load.size());
+
+            ns = timeOnce([&](){
+                for(int id : w.searchIds)
+                    benchmarkSink = (size_t)frozen.search(id);
+            });
+            frozen_reps.add(ns, w.searchIds.size());
+
+            vector<const RecordT*> frozen_found(w.searchIds.size());
+            ns = timeOnce([&](){
+                frozen.searchBatch(w.searchIds.data(), w.searchIds.size(), frozen_found.data());
+            });
+            frozen_batch_reps.add(ns, w.searchIds.size());
+        }
+
+        if constexpr (hasSetOperations<T>::value){
+            // two partitions overlapping in half their ids: the first and
+            // second halves of the preload against its middle half
+            size_t n = w.load.size();
+            auto partitions = [&](T*& a, T*& b){
+                a = makeTable();
+                b = makeTable();
+                a->bulkLoad(w.load.begin(), w.load.begin() + n / 2);
+                a->bulkLoad(w.load.begin() + n / 2 + n / 4, w.load.end());
+                b->bulkLoad(w.load.begin() + n / 4, w.load.begin() + n / 2 + n / 4);
+            };
+            T *a, *b;
+
+            partitions(a, b);
+            ns = timeOnce([&](){
+                b->rangeScan(INT_MIN, INT_MAX, [&](const RecordT& rec){
+                    a->insert(rec);
+                });
+            });
+            reinsert_reps.add(ns, n / 2);
+            delete a;
+            delete b;
+
+            partitions(a, b);
+            ns = timeOnce([&](){
+                a->unionWith(*b);
+            });
+            union_reps.add(ns, n / 2);
+            delete a;
+            delete b;
+
+            partitions(a, b);
+            ns = timeOnce([&](){
+                a->difference(*b);
+            });
+            difference_reps.add(ns, n / 2);
+            delete a;
+            delete b;
+        }
+
+        if constexpr (hasOrderStatistics<T>::value){
+            ns = timeOnce([&](){
+                for(int id : w.searchIds)
+                    benchmarkSink += rebuilt->countRange(id, id + COUNT_RANGE_SPAN);
+            });
+            count_reps.add(ns, w.searchIds.size());
+
+            long n = rebuilt->size();
+            ns = timeOnce([&](){
+                for(int id : w.searchIds)
+                    benchmarkSink = (size_t)rebuilt->select(n ? (unsigned)id % n : 0);
+            });
+            select_reps.add(ns, w.searchIds.size());
+        }
+
+        // delete-heavy phase: every other preloaded record, in load order
+        ns = timeEach(w.load.size() / 2, remove_latency, [&](size_t i){
+            rebuilt->remove(w.load[2 * i].id);
+        });
+        remove_reps.add(ns, w.load.size() / 2);
+
+        // lazy removes leave dead records behind for one compaction to drop
+        if constexpr (hasLazyRemove<T>::value){
+            lazy = rebuilt->lazyRemove();
+            if(lazy){
+                ns = timeOnce([&](){ rebuilt->compact(); });
+                compact_reps.add(ns, w.load.size() / 2);
+            }
+        }
+        delete rebuilt;
+    }
 
-    for(int i=0;i<record_size;i++){
-        Record rec = getDummyRecord();
-        table->insert(rec);
+    results.push_back(makeResult(name, layout, "load", dist, 1, w.load.size(), load_reps, &load_latency));
+    results.push_back(makeResult(name, layout, "mixed", dist, 1, w.ops.size(), mixed_reps, &mixed_latency));
+    results.push_back(makeResult(name, layout, "batch-search", dist, 1, w.searchIds.size(), batch_reps, nullptr));
+    results.push_back(makeResult(name, layout, "bulk-load", dist, 1, w.load.size(), bulk_reps, nullptr));
+    if constexpr (hasRangeScan<T>::value){
+        results.push_back(makeResult(name, layout, "range-scan", dist, 1, w.load.size(), scan_reps, nullptr));
     }
+    if constexpr (hasFreeze<T>::value){
+        results.push_back(makeResult(name, layout, "search", dist, 1, w.searchIds.size(), search_reps, nullptr));
+        results.push_back(makeResult(name, layout, "freeze", dist, 1, w.load.size(), freeze_reps, nullptr));
+        results.push_back(makeResult(name, layout, "frozen-search", dist, 1, w.searchIds.size(), frozen_reps, nullptr));
+        results.push_back(makeResult(name, layout, "frozen-batch", dist, 1, w.searchIds.size(), frozen_batch_reps, nullptr));
+    }
+    if constexpr (hasSetOperations<T>::value){
+        results.push_back(makeResult(name, layout, "reinsert", dist, 1, w.load.size() / 2, reinsert_reps, nullptr));
+        results.push_back(makeResult(name, layout, "union", dist, 1, w.load.size() / 2, union_reps, nullptr));
+        results.push_back(makeResult(name, layout, "difference", dist, 1, w.load.size() / 2, difference_reps, nullptr));
+    }
+    if constexpr (hasOrderStatistics<T>::value){
+        results.push_back(makeResult(name, layout, "count-range", dist, 1, w.searchIds.size(), count_reps, nullptr));
+        results.push_back(makeResult(name, layout, "select", dist, 1, w.searchIds.size(), select_reps, nullptr));
+    }
+    results.push_back(makeResult(name, layout, "remove", dist, 1, w.load.size() / 2, remove_reps, &remove_latency));
+    if(lazy){
+        results.push_back(makeResult(name, layout, "compact", dist, 1, w.load.size() / 2, compact_reps, nullptr));
+    }
+}
+
 
-    auto stop = high_resolution_clock::now();
+// The BTree behind one global mutex: what callers had to do before OLCBTree
+class LockedBTree {
+    mutex m;
+    BasicBTree<CompactRecord> tree;
 
-    auto duration = duration_cast<microseconds>(stop - start);
+public:
+    LockedBTree() : tree(OLC_INNER_KEYS + 1) {}
 
+    void insert(const CompactRecord& rec){
+        lock_guard<mutex> guard(m);
+        tree.insert(rec);
+    }
 
-    return (double)(duration.count()*1.0);
+    bool contains(int id){
+        lock_guard<mutex> guard(m);
+        return tree.search(id) != nullptr;
+    }
 
+    void remove(int id){
+        lock_guard<mutex> guard(m);
+        tree.remove(id);
+    }
+};
+
+
+// Shared-nothing scaling: ids are partitioned across one index instance per
+// worker thread, each pinned to a core. Every worker generates its own slice
+// of the workload (see shardWorkload), loads its instance and runs its slice
+// of the mixed stream, so the threads never touch shared data. Reports load
+// and mixed wall time per operation, the inverse of aggregate throughput,
+// doubling the thread count up to opt.maxThreads.
+template<typename T, typename RecordT>
+void benchmarkSharded(const string& name, function<T*()> makeTable,
+                      const BenchmarkOptions& opt, vector<BenchmarkResult>& results){
+    static_assert(isPointIndex<T>, "benchmarkSharded needs insert, search and remove");
+    string dist = distributionName(opt.workload.distribution);
+
+    for(int threads=1;;threads*=2){
+        if(threads > opt.maxThreads) threads = opt.maxThreads;
+
+        RepetitionStats load_reps, mixed_reps;
+        LatencyRecorder latency;
+        size_t loaded = 0, ops = 0;
+        for(int rep=0;rep<opt.repetitions;rep++){
+            vector<Workload<RecordT>> shards(threads);
+            vector<vector<RecordT>> inserts(threads);
+            vector<T*> tables(threads);
+            runPinned(threads, [&](int t){
+                shards[t] = shardWorkload<RecordT>(opt.workload, threads, t);
+                inserts[t] = shards[t].inserts;
+                tables[t] = makeTable();
+            });
+
+            loaded = ops = 0;
+            for(auto &w : shards){
+                loaded += w.load.size();
+                ops += w.ops.size();
+            }
+
+            double ns = timeOnce([&](){
+                runPinned(threads, [&](int t){
+                    for(RecordT& rec : shards[t].load){
+                        tables[t]->insert(std::move(rec));
+                    }
+                });
+            });
+            load_reps.add(ns, loaded);
+
+            vector<LatencyRecorder> perThread(threads);
+            ns = timeOnce([&](){
+                runPinned(threads, [&](int t){
+                    const vector<Operation>& stream = shards[t].ops;
+                    timeEach(stream.size(), perThread[t], [&](size_t i){
+                        applyOperation(tables[t], stream[i], inserts[t]);
+                    });
+                });
+            });
+            mixed_reps.add(ns, ops);
+            for(auto &l : perThread){
+                latency.merge(l);
+            }
+
+            for(T *table : tables){
+                delete table;
+            }
+        }
+        results.push_back(makeResult(name, opt.layout, "sharded-load", dist, threads, loaded, load_reps, nullptr));
+        results.push_back(makeResult(name, opt.layout, "sharded-mixed", dist, threads, ops, mixed_reps, &latency));
+
+        if(threads == opt.maxThreads) break;
+    }
 }
 
-template<typename T>
-double searchingTime(T *&table, int record_size){
-    auto start = high_resolution_clock::now();
 
-    for(int i=0;i<record_size;i++){
-        int id = getRandomID();
-        table->search(id);
+// Single-threaded indexes run either serially or sharded across threads
+template<typename T, typename RecordT>
+void benchmarkIndex(const string& name, function<T*()> makeTable, const Workload<RecordT>& w,
+                    const BenchmarkOptions& opt, vector<BenchmarkResult>& results,
+                    vector<pair<string, ArenaStats>>& arenas, vector<pair<string, IndexStats>>& stats){
+    if(opt.mode == "sharded") benchmarkSharded<T, RecordT>(name, makeTable, opt, results);
+    else benchmarkTree<T>(name, makeTable, w, opt, results, arenas, stats);
+}
+
+
+// The AVL tree behind one global mutex, the baseline for the lock-free skip list
+class LockedAVL {
+    mutex m;
+    BasicAVL<CompactRecord> tree;
+
+public:
+    void insert(const CompactRecord& rec){
+        lock_guard<mutex> guard(m);
+        tree.insert(rec);
+    }
+
+    bool contains(int id){
+        lock_guard<mutex> guard(m);
+        return tree.search(id) != nullptr;
+    }
+
+    void remove(int id){
+        lock_guard<mutex> guard(m);
+        tree.remove(id);
     }
+};
 
-    auto stop = high_resolution_clock::now();
 
-    auto duration = duration_cast<microseconds>(stop - start);
+// The mixed stream split into contiguous slices, one per thread, on a
+// preloaded table; doubles the thread count up to opt.maxThreads
+template<typename T>
+void benchmarkConcurrent(const string& name, const Workload<CompactRecord>& w,
+                         const BenchmarkOptions& opt, vector<BenchmarkResult>& results){
+    string dist = distributionName(opt.workload.distribution);
+
+    for(int threads=1;;threads*=2){
+        if(threads > opt.maxThreads) threads = opt.maxThreads;
+
+        RepetitionStats reps;
+        LatencyRecorder latency;
+        for(int rep=0;rep<opt.repetitions;rep++){
+            T *table = new T();
+            for(const CompactRecord& rec : w.load){
+                table->insert(rec);
+            }
+
+            vector<LatencyRecorder> perThread(threads);
+            vector<thread> workers;
+            size_t n = w.ops.size();
+            double ns = timeOnce([&](){
+                for(int t=0;t<threads;t++){
+                    workers.emplace_back([&, t](){
+                        size_t lo = n * t / threads, hi = n * (t + 1) / threads;
+                        timeEach(hi - lo, perThread[t], [&](size_t i){
+                            const Operation& op = w.ops[lo + i];
+                            if(op.type == OpType::Search) benchmarkSink = table->contains(op.id);
+                            else if(op.type == OpType::Insert) table->insert(w.inserts[op.record]);
+                            else table->remove(op.id);
+                        });
+                    });
+                }
+                for(auto &worker : workers){
+                    worker.join();
+                }
+            });
+            // wall time per operation: the inverse of aggregate throughput
+            reps.add(ns, n);
+            for(auto &l : perThread){
+                latency.merge(l);
+            }
+            delete table;
+        }
+        results.push_back(makeResult(name, "compact", "mixed", dist, threads, w.ops.size(), reps, &latency));
+
+        if(threads == opt.maxThreads) break;
+    }
+}
 
 
-    return (double)(duration.count()*1.0);
+// Build a DiskBTree file, reopen it as a fresh process would and search it
+template<typename T, typename RecordT>
+void benchmarkDisk(const string& name, const string& path, const Workload<RecordT>& w,
+                   const BenchmarkOptions& opt, vector<BenchmarkResult>& results){
+    string dist = distributionName(opt.workload.distribution);
+    RepetitionStats build_reps, open_reps, search_reps;
+    LatencyRecorder search_latency;
+
+    for(int rep=0;rep<opt.repetitions;rep++){
+        unlink(path.c_str());
+        double ns = timeOnce([&](){
+            T table(path);
+            table.bulkLoad(w.load.begin(), w.load.end());
+            table.sync();
+        });
+        build_reps.add(ns, w.load.size());
+
+        T *table = nullptr;
+        ns = timeOnce([&](){
+            table = new T(path);
+            benchmarkSink = (size_t)table->search(w.load[0].id);
+        });
+        open_reps.add(ns, 1);
+
+        ns = timeEach(w.searchIds.size(), search_latency, [&](size_t i){
+            benchmarkSink = (size_t)table->search(w.searchIds[i]);
+        });
+        search_reps.add(ns, w.searchIds.size());
+
+        delete table;
+        unlink(path.c_str());
+    }
 
+    results.push_back(makeResult(name, "compact", "build+sync", dist, 1, w.load.size(), build_reps, nullptr));
+    results.push_back(makeResult(name, "compact", "cold-start", dist, 1, 1, open_reps, nullptr));
+    results.push_back(makeResult(name, "compact", "search", dist, 1, w.searchIds.size(), search_reps, &search_latency));
 }
 
 
+// Parse a CSV file with getline and insert its rows one at a time: the
+// loader callers wrote by hand before ingestFile()
 template<typename T>
-double deletionTime(T *&table, int record_size){
-    auto start = high_resolution_clock::now();
+size_t ingestByLine(T& table, const string& path){
+    ifstream in(path);
+    string line;
+    size_t rows = 0;
+    while(getline(in, line)){
+        size_t a = line.find(','), b = line.rfind(',');
+        if(a == string::npos || a == b) continue;
+        table.insert(typename T::RecordType(stoi(line.substr(0, a)), line.substr(a + 1, b - a - 1), stoi(line.substr(b + 1))));
+        rows++;
+    }
+    return rows;
+}
+
 
-    for(int i=0;i<record_size;i++){
-        int id = getRandomID();
-        table->remove(id);
+// Load one tree from the preload written out as CSV and binary files:
+// ingestFile() on one thread and on opt.maxThreads, against ingestByLine()
+template<typename T, typename RecordT>
+void benchmarkIngestInto(const string& name, function<T*()> makeTable, const string& csvPath, const string& binPath,
+                         const Workload<RecordT>& w, const BenchmarkOptions& opt, vector<BenchmarkResult>& results,
+                         vector<pair<string, IngestReport>>& ingests){
+    string dist = distributionName(opt.workload.distribution);
+    vector<int> threadCounts = {1};
+    if(opt.maxThreads > 1) threadCounts.push_back(opt.maxThreads);
+
+    for(int threads : threadCounts){
+        for(const string& path : {csvPath, binPath}){
+            RepetitionStats reps;
+            IngestReport report;
+            IngestOptions options;
+            options.threads = threads;
+            for(int rep=0;rep<opt.repetitions;rep++){
+                T *table = makeTable();
+                double ns = timeOnce([&](){
+                    report = ingestFile(*table, path, options);
+                });
+                reps.add(ns, report.rows);
+                delete table;
+            }
+            string phase = report.binary ? "ingest-bin" : "ingest-csv";
+            results.push_back(makeResult(name, opt.layout, phase, dist, threads, report.rows, reps, nullptr));
+            ingests.push_back({name + " " + to_string(threads), report});
+        }
     }
 
-    auto stop = high_resolution_clock::now();
+    RepetitionStats line_reps;
+    for(int rep=0;rep<opt.repetitions;rep++){
+        T *table = makeTable();
+        size_t rows = 0;
+        double ns = timeOnce([&](){
+            rows = ingestByLine(*table, csvPath);
+        });
+        line_reps.add(ns, rows);
+        delete table;
+    }
+    results.push_back(makeResult(name, opt.layout, "getline-csv", dist, 1, w.load.size(), line_reps, nullptr));
+}
 
-    auto duration = duration_cast<microseconds>(stop - start);
 
+// File ingest into the AVL, BST and BTree; the files are written once, untimed
+template<typename RecordT>
+void benchmarkIngest(const string& path, const Workload<RecordT>& w, const BenchmarkOptions& opt,
+                     vector<BenchmarkResult>& results, vector<pair<string, IngestReport>>& ingests){
+    string csvPath = path + ".csv", binPath = path + ".bin";
+    writeCsvRecords(csvPath, w.load.begin(), w.load.end());
+    writeBinaryRecords(binPath, w.load.begin(), w.load.end());
+    int degree = opt.btreeDegree;
 
+    benchmarkIngestInto<BasicAVL<RecordT>>("AVL", [](){ return new BasicAVL<RecordT>(); }, csvPath, binPath, w, opt, results, ingests);
+    benchmarkIngestInto<BasicBST<RecordT>>("BST", [](){ return new BasicBST<RecordT>(); }, csvPath, binPath, w, opt, results, ingests);
+    benchmarkIngestInto<BasicBTree<RecordT>>("BTREE", [degree](){ return new BasicBTree<RecordT>(degree); }, csvPath, binPath, w, opt, results, ingests);
 
-    return (double)(duration.count()*1.0);
+    unlink(csvPath.c_str());
+    unlink(binPath.c_str());
 }
 
 
+// Queries per repetition of the secondary-index phases; each full scan reads every record
+const size_t SECONDARY_QUERIES = 20;
+
+// Predicate lookups on age and name: SecondaryIndexed over a BTree against
+// a rangeScan of the same tree that tests every record. The table is built
+// once, untimed; the queries are single ages and two-letter name prefixes.
+template<typename RecordT>
+void benchmarkSecondary(const Workload<RecordT>& w, const BenchmarkOptions& opt, vector<BenchmarkResult>& results){
+    string dist = distributionName(opt.workload.distribution);
+    SecondaryIndexed<BasicBTree<RecordT>> table(opt.btreeDegree);
+    table.bulkLoad(w.load.begin(), w.load.end());
+
+    Xoshiro256 rng(opt.workload.seed);
+    vector<int> ages;
+    vector<string> prefixes;
+    for(size_t q=0;q<SECONDARY_QUERIES;q++){
+        ages.push_back((int)rng.below(100));
+        prefixes.push_back(randomName(rng).substr(0, 2));
+    }
+
+    auto hasPrefix = [](const RecordT& rec, const string& prefix){
+        return recordName(rec).substr(0, prefix.size()) == prefix;
+    };
+    struct Phase {
+        string name;
+        function<size_t(size_t)> query;      // runs query q, returns the records matched
+    };
+    vector<Phase> phases = {
+        {"age-index", [&](size_t q){
+            return table.findByAge(ages[q], ages[q], [](const RecordT& rec){ benchmarkSink += rec.id; });
+        }},
+        {"age-scan", [&](size_t q){
+            size_t hits = 0;
+            table.tree().rangeScan(INT_MIN, INT_MAX, [&](const RecordT& rec){
+                if((int)rec.age == ages[q]){ benchmarkSink += rec.id; hits++; }
+            });
+            return hits;
+        }},
+        {"prefix-index", [&](size_t q){
+            return table.findByNamePrefix(prefixes[q], [](const RecordT& rec){ benchmarkSink += rec.id; });
+        }},
+        {"prefix-scan", [&](size_t q){
+            size_t hits = 0;
+            table.tree().rangeScan(INT_MIN, INT_MAX, [&](const RecordT& rec){
+                if(hasPrefix(rec, prefixes[q])){ benchmarkSink += rec.id; hits++; }
+            });
+            return hits;
+        }},
+    };
+
+    for(const Phase& phase : phases){
+        RepetitionStats reps;
+        for(int rep=0;rep<opt.repetitions;rep++){
+            double ns = timeOnce([&](){
+                for(size_t q=0;q<SECONDARY_QUERIES;q++) benchmarkSink += phase.query(q);
+            });
+            reps.add(ns, SECONDARY_QUERIES);
+        }
+        results.push_back(makeResult("SECONDARY BTREE", opt.layout, phase.name, dist, 1, SECONDARY_QUERIES, reps, nullptr));
+    }
+}
+
 
+// Operations run with a sync per mutation; fdatasync is too slow for the full stream
+const size_t WAL_SYNC_EACH_OPS = 10000;
+
+// Cost of logging: the mixed stream on an in-memory BTree and on the same
+// tree behind a write-ahead log at several group-commit intervals, then the
+// time to recover the table from its snapshot and log
+template<typename RecordT>
+void benchmarkDurable(const string& path, const Workload<RecordT>& w,
+                      const BenchmarkOptions& opt, vector<BenchmarkResult>& results){
+    typedef BasicBTree<RecordT> Tree;
+    string dist = distributionName(opt.workload.distribution);
+    int degree = opt.btreeDegree;
+
+    struct Variant {
+        string name;
+        long intervalUs;                 // -1: no log
+        size_t ops;
+    };
+    vector<Variant> variants = {
+        {"BTREE MEMORY", -1, w.ops.size()},
+        {"WAL GROUP 10MS", 10000, w.ops.size()},
+        {"WAL GROUP 1MS", 1000, w.ops.size()},
+        {"WAL SYNC EACH", 0, min(w.ops.size(), WAL_SYNC_EACH_OPS)},
+    };
+
+    for(const Variant& v : variants){
+        RepetitionStats mixed_reps, recover_reps;
+        LatencyRecorder latency;
+        WalOptions options;
+        options.flushInterval = chrono::microseconds(max(0L, v.intervalUs));
+
+        for(int rep=0;rep<opt.repetitions;rep++){
+            vector<RecordT> inserts = w.inserts;
+            unlink((path + ".wal").c_str());
+            unlink((path + ".snap").c_str());
+
+            if(v.intervalUs < 0){
+                Tree table(degree);
+                table.bulkLoad(w.load.begin(), w.load.end());
+                double ns = timeEach(v.ops, latency, [&](size_t i){
+                    applyOperation(&table, w.ops[i], inserts);
+                });
+                mixed_reps.add(ns, v.ops);
+                continue;
+            }
+
+            DurableIndex<Tree> *table = new DurableIndex<Tree>(path, options, degree);
+            table->bulkLoad(w.load.begin(), w.load.end());
+            double ns = timeEach(v.ops, latency, [&](size_t i){
+                applyOperation(table, w.ops[i], inserts);
+            });
+            table->sync();
+            mixed_reps.add(ns, v.ops);
+            delete table;
+
+            // snapshot bulk-load plus replay of the mixed stream's log
+            ns = timeOnce([&](){
+                DurableIndex<Tree> reopened(path, options, degree);
+                benchmarkSink = reopened.replayedEntries();
+            });
+            recover_reps.add(ns, w.load.size());
+        }
+        results.push_back(makeResult(v.name, opt.layout, "mixed", dist, 1, v.ops, mixed_reps, &latency));
+        if(v.intervalUs >= 0){
+            results.push_back(makeResult(v.name, opt.layout, "recover", dist, 1, w.load.size(), recover_reps, nullptr));
+        }
+    }
+    unlink((path + ".wal").c_str());
+    unlink((path + ".snap").c_str());
+}
 
-signed main(){
-    srand(time(NULL));
-    AVL *avl_table = new AVL();
-    BST *bst_table = new BST();
-    BTree *btree_table = new BTree(3);
-    vector<double> avg_insertion_times(3);
-    vector<double> avg_searching_times(3);
-    vector<double> avg_deletion_times(3);
 
+// Structural counters and per-type latency from the last repetition; only
+// collected when built with -DRECORD_STATS
+void printIndexStats(string name, const IndexStats& s){
+    cout << left << setw(15) << name
+         << setw(12) << fixed << setprecision(2) << s.meanNodesVisited()
+         << setw(12) << s.searchVisits.percentile(0.99)
+         << setw(12) << s.rotations
+         << setw(10) << s.splits
+         << setw(10) << s.merges
+         << setw(10) << s.borrows
+         << setw(14) << s.searchLatency.percentile(0.99)
+         << setw(14) << s.insertLatency.percentile(0.99)
+         << s.removeLatency.percentile(0.99) << endl;
+}
 
-    string operations[3] = {"Insertion", "Searching", "Deletion"};
 
-    int record_size = 10000000;
-    // inserting, searching, and deleting 1000 records in AVL
-    avg_insertion_times[0] = insertionTime(avl_table, record_size);
-    avg_searching_times[0] = searchingTime(avl_table, record_size);
-    avg_deletion_times[0] = deletionTime(avl_table, record_size);
+void printIngestReport(string name, const IngestReport& r){
+    cout << left << setw(15) << name
+         << setw(8) << (r.binary ? "binary" : "csv")
+         << setw(12) << r.rows
+         << setw(10) << r.skipped
+         << setw(10) << r.batches
+         << setw(12) << fixed << setprecision(1) << r.bytes / (1024.0 * 1024.0)
+         << setw(14) << setprecision(0) << r.rowsPerSecond()
+         << setw(10) << setprecision(1) << r.bytesPerSecond() / (1024.0 * 1024.0)
+         << setprecision(1) << 100.0 * r.parseSeconds / max(r.seconds(), 1e-9) << endl;
+}
 
-    // inserting, searching, and deleting 1000 records in bst
-    avg_insertion_times[1] = insertionTime(bst_table, record_size);
-    avg_searching_times[1] = searchingTime(bst_table, record_size);
-    avg_deletion_times[1] = deletionTime(bst_table, record_size);
 
+void printArenaStats(string name, ArenaStats s){
+    cout << left << setw(15) << name
+         << setw(10) << s.chunks
+         << setw(14) << s.reservedNodes
+         << setw(12) << s.liveNodes
+         << setw(12) << s.freeListNodes
+         << fixed << setprecision(3) << s.reservedBytes / (1024.0 * 1024.0) << endl;
+}
 
-    // inserting, searching, and deleting 1000 records in btree
-    avg_insertion_times[2] = insertionTime(btree_table, record_size);
-    avg_searching_times[2] = searchingTime(btree_table, record_size);
-    avg_deletion_times[2] = deletionTime(btree_table, record_size);
 
+template<typename RecordT>
+void runSuite(const BenchmarkOptions& opt){
+    Workload<RecordT> w = generateWorkload<RecordT>(opt.workload);
+    vector<BenchmarkResult> results;
+    vector<pair<string, ArenaStats>> arenas;
+    vector<pair<string, IndexStats>> stats;
+    vector<pair<string, IngestReport>> ingests;
+    int degree = opt.btreeDegree;
 
-    cout << left << setw(15) << "Operation"
-         << setw(10) << "AVL"
-         << setw(10) << "BST"
-         << setw(10) << "BTREE" << endl;
-        
-    cout << string(50, '-') << endl;
+    if(selected(opt, "avl")){
+        benchmarkIndex<BasicAVL<RecordT>>("AVL", [](){ return new BasicAVL<RecordT>(); }, w, opt, results, arenas, stats);
+    }
+    if(selected(opt, "bst")){
+        benchmarkIndex<BasicBST<RecordT>>("BST", [](){ return new BasicBST<RecordT>(); }, w, opt, results, arenas, stats);
+    }
+    if(selected(opt, "btree")){
+        benchmarkIndex<BasicBTree<RecordT>>("BTREE", [degree](){ return new BasicBTree<RecordT>(degree); }, w, opt, results, arenas, stats);
+        // removes only mark records dead; the compact phase drops them
+        benchmarkIndex<BasicBTree<RecordT>>("BTREE LAZY", [degree](){
+            BasicBTree<RecordT>* tree = new BasicBTree<RecordT>(degree);
+            tree->setLazyRemove(true);
+            return tree;
+        }, w, opt, results, arenas, stats);
+    }
+    if(selected(opt, "btree64")){
+        // fan-out fixed at compile time, so each node is one inline allocation
+        benchmarkIndex<BasicBTree<RecordT, 64>>("BTREE<64>", [](){ return new BasicBTree<RecordT, 64>(); }, w, opt, results, arenas, stats);
+        benchmarkIndex<BasicBTree<RecordT, 64>>("BTREE<64> LAZY", [](){
+            BasicBTree<RecordT, 64>* tree = new BasicBTree<RecordT, 64>();
+            tree->setLazyRemove(true);
+            return tree;
+        }, w, opt, results, arenas, stats);
+    }
+    if(selected(opt, "bptree")){
+        benchmarkIndex<BasicBPTree<RecordT>>("B+TREE", [](){ return new BasicBPTree<RecordT>(); }, w, opt, results, arenas, stats);
+    }
+    if(selected(opt, "hash")){
+        benchmarkIndex<BasicHashIndex<RecordT>>("HASH", [](){ return new BasicHashIndex<RecordT>(); }, w, opt, results, arenas, stats);
+    }
+    if(selected(opt, "lsm")){
+        // memtable sizes from cache-resident to well past L2
+        for(size_t buffer : {256, 4096, 65536}){
+            string name = "LSM " + to_string(buffer);
+            benchmarkIndex<BasicLSMIndex<RecordT>>(name, [buffer](){ return new BasicLSMIndex<RecordT>(buffer); }, w, opt, results, arenas, stats);
+        }
+    }
 
-    cout << left << setw(15) << operations[0]
-        << setw(10) <<  fixed << setprecision(3) << avg_insertion_times[0]
-        << setw(10) <<  fixed << setprecision(3) << avg_insertion_times[1]
-        << setw(10) <<  fixed << setprecision(3) << avg_insertion_times[2] << endl;
+    if(selected(opt, "olc")){
+        // the concurrent trees copy records out, so they always use the compact layout
+        Workload<CompactRecord> cw = generateWorkload<CompactRecord>(opt.workload);
+        benchmarkConcurrent<OLCBTree>("OLC BTREE", cw, opt, results);
+        benchmarkConcurrent<LockedBTree>("LOCKED BTREE", cw, opt, results);
+    }
 
-    cout << left << setw(15) << operations[1]
-    << setw(10) <<  fixed << setprecision(3) << avg_searching_times[0]
-    << setw(10) <<  fixed << setprecision(3) << avg_searching_times[1]
-    << setw(10) <<  fixed << setprecision(3) << avg_searching_times[2] << endl;
+    if(selected(opt, "skiplist")){
+        Workload<CompactRecord> cw = generateWorkload<CompactRecord>(opt.workload);
+        benchmarkConcurrent<SkipList>("SKIPLIST", cw, opt, results);
+        benchmarkConcurrent<LockedAVL>("LOCKED AVL", cw, opt, results);
+    }
 
-    cout << left << setw(15) << operations[2]
-        << setw(10) <<  fixed << setprecision(3) << avg_deletion_times[0]
-        << setw(10) <<  fixed << setprecision(3) << avg_deletion_times[1]
-        << setw(10) <<  fixed << setprecision(3) << avg_deletion_times[2] << endl;
-        
+    if(selected(opt, "disk")){
+        benchmarkDisk<DiskBTree>("DISK BTREE 4K", "records_4k.idx", w, opt, results);
+        benchmarkDisk<DiskBTree16K>("DISK BTREE 16K", "records_16k.idx", w, opt, results);
+    }
 
-}
\ No newline at end of file
+    if(selected(opt, "wal")){
+        benchmarkDurable("records_wal", w, opt, results);
+    }
+
+    if(selected(opt, "ingest")){
+        benchmarkIngest("records_ingest", w, opt, results, ingests);
+    }
+
+    if(selected(opt, "secondary")){
+        benchmarkSecondary(w, opt, results);
+    }
+
+    printReport(results, opt.format, cout);
+
+    if(opt.format == "table" && !arenas.empty()){
+        cout << endl;
+        cout << left << setw(15) << "Arena"
+             << setw(10) << "Chunks"
+             << setw(14) << "Reserved"
+             << setw(12) << "Live"
+             << setw(12) << "Free"
+             << "MiB" << endl;
+
+        cout << string(70, '-') << endl;
+
+        for(auto &a : arenas){
+            printArenaStats(a.first, a.second);
+        }
+    }
+
+    if(opt.format == "table" && !ingests.empty()){
+        cout << endl;
+        cout << left << setw(15) << "Ingest"
+             << setw(8) << "Format"
+             << setw(12) << "Rows"
+             << setw(10) << "Skipped"
+             << setw(10) << "Batches"
+             << setw(12) << "MiB"
+             << setw(14) << "Rows/s"
+             << setw(10) << "MiB/s"
+             << "Parse %" << endl;
+
+        cout << string(100, '-') << endl;
+
+        for(auto &in : ingests){
+            printIngestReport(in.first, in.second);
+        }
+    }
+
+    if(opt.format == "table" && RECORD_STATS_ENABLED && !stats.empty()){
+        cout << endl;
+        cout << left << setw(15) << "Stats"
+             << setw(12) << "Visits"
+             << setw(12) << "p99 Visits"
+             << setw(12) << "Rotations"
+             << setw(10) << "Splits"
+             << setw(10) << "Merges"
+             << setw(10) << "Borrows"
+             << setw(14) << "p99 Search"
+             << setw(14) << "p99 Insert"
+             << "p99 Remove" << endl;
+
+        cout << string(120, '-') << endl;
+
+        for(auto &st : stats){
+            printIndexStats(st.first, st.second);
+        }
+    }
+}
+
+
+int main(int argc, char** argv){
+    BenchmarkOptions opt;
+    try {
+        opt = parseOptions(argc, argv);
+    } catch(const exception& e) {
+        cerr << e.what() << endl;
+        printUsage(argv[0]);
+        return 1;
+    }
+
+    if(opt.format == "table"){
+        const WorkloadConfig& c = opt.workload;
+        cout << "records=" << c.records << " ops=" << c.operations
+             << " dist=" << distributionName(c.distribution)
+             << " hit=" << c.hitRatio << " read=" << c.readPercent << "% insert=" << c.insertPercent
+             << "% seed=" << c.seed << " reps=" << opt.repetitions << " layout=" << opt.layout << endl << endl;
+    }
+
+    try {
+        if(opt.layout == "compact") runSuite<CompactRecord>(opt);
+        else runSuite<Record>(opt);
+    } catch(const exception& e) {
+        cerr << e.what() << endl;
+        return 1;
+    }
+    return 0;
+}